@@ -4,26 +4,82 @@
  * @author ist1106369 Sophia Alencar
 */
 
+#include <sched.h>
+#include <ctype.h>
+#include <math.h>
+
 #include "aux.h"
+#include "shard.h"
 
 
 /** 
- * Initializes the parking array in the parking_args structure.
+ * Initializes the parking registry in the parking_args structure.
  * @param parking_args Pointer to the args structure containing 
  * parking information.
  */
 void initialize_parking_list(args *parking_args) {
     int i;
+    parking_registry *registry = &parking_args->registry;
 
     /** Set counters to 0. */
-    parking_args->park_counter = 0;
+    registry->num_ids = 0;
+    registry->num_parkings = 0;
+    registry->index_used = 0;
+    registry->removed = NULL;
+    registry->last_removed = NULL;
     parking_args->num_logs = 0;
+    parking_args->command_version = 0;
+    parking_args->engine = NULL;
+    parking_args->checkpoint_path = NULL;
+    parking_args->wal = NULL;
+    parking_args->last_sequence = 0;
+
+    /** Allocate the parkings arrays and the name index. */
+    registry->capacity = INITIAL_PARKINGS;
+    registry->index_length = INITIAL_NAME_INDEX;
+    registry->parkings = (parking **)tracked_malloc(sizeof(parking *) * registry->capacity,
+        ALLOC_REGISTRY);
+    registry->sorted = (parking **)tracked_malloc(sizeof(parking *) * registry->capacity,
+        ALLOC_REGISTRY);
+    registry->name_index = (int *)tracked_malloc(sizeof(int) * registry->index_length,
+        ALLOC_REGISTRY);
+    if (registry->parkings == NULL || registry->sorted == NULL || 
+        registry->name_index == NULL) {
+        fprintf(stderr, "Memory allocation of parking registry failed\n");
+        return;
+    }
+
+    /** Initialize the name index with empty slots. */
+    for (i = 0; i < registry->index_length; i++) {
+        registry->name_index[i] = EMPTY_SLOT;
+    }
+}
+
+/**
+ * Allocates an empty table of entries.
+ * @param length The length of the table (a power of 2).
+ * @param old The table before growing, NULL if none.
+ * @return Pointer to the table, or NULL if it could not be allocated.
+ */
+static entry_table *new_entry_table(int length, entry_table *old) {
+    entry_table *table;
 
-    /** Initialize parkings array with NULL values. */
-    for (i = 0; i < MAX_PARKINGS; i++) {
-        parking_args->parkings[i] = NULL;
+    /** Zeroed entries are empty (EMPTY_KEY). */
+    if ((table = (entry_table *)tracked_calloc(1, sizeof(entry_table) + 
+        sizeof(entry) * length, ALLOC_ENTRY)) == NULL) {
+        return NULL;
     }
+    table->length = length;
+    table->old = old;
+    return table;
+}
 
+/**
+ * Frees a table of entries.
+ * @param table Pointer to the table.
+ */
+static void free_entry_table(entry_table *table) {
+    tracked_free(table, sizeof(entry_table) + sizeof(entry) * table->length, ALLOC_ENTRY);
 }
 
 /** 
@@ -33,140 +89,264 @@ void initialize_parking_list(args *parking_args) {
  */
 void initialize_hashtable(args *parking_args) {
     /** Allocate memory for the hashtable. */
-    if ((parking_args->vehicles = (hashtable*)malloc(sizeof(hashtable))) == NULL) {
+    if ((parking_args->vehicles = (hashtable*)tracked_malloc(sizeof(hashtable), ALLOC_OTHER)) == NULL) {
         fprintf(stderr,"Memory allocation of hashtable vehicles failed\n");
         return;
     }
 
-    /** Set last_date to -1 for further error checking. */
-    date invalid = { -1, -1, -1, -1, -1 };
-    parking_args->last_date = invalid;
+    /** No date was recorded yet. */
+    parking_args->last_date = NO_DATE;
 
-    /** Set hashtable length and num_entries. */
-    parking_args->vehicles->length = INITIAL_LENGTH;
+    /** Set hashtable num_entries, it is not shared until asked. */
     parking_args->vehicles->num_entries = 0;
+    parking_args->vehicles->shared = 0;
+    parking_args->vehicles->retired = NULL;
+    pthread_rwlock_init(&parking_args->vehicles->grow_lock, NULL);
+    initialize_pool(&parking_args->vehicles->vehicle_pool, sizeof(vehicle), ALLOC_VEHICLE);
 
     /** Allocate memory for hashtable entries. */
-    if ((parking_args->vehicles->entries = (entry*)calloc(sizeof(entry), 
-        parking_args->vehicles->length)) == NULL) {
-        printf("Memory allocation of entries failed\n");
+    if ((parking_args->vehicles->table = new_entry_table(INITIAL_LENGTH, NULL)) == NULL) {
+        output_string("Memory allocation of entries failed\n");
         free_hashtable(parking_args->vehicles);
+        parking_args->vehicles = NULL;
         return;
     }
 }
 
 /**
- * Extracts the name from the given buffer.
- * @param buffer The input string from which to extract the name.
- * @return The extracted name, or NULL if no name is found.
+ * Marks the hashtable as shared: from now on other threads may look up
+ * vehicles while it grows, so the tables it replaces are kept until it
+ * is freed instead of being freed right away.
+ * @param ht Pointer to the hashtable.
  */
-char *parse_name(char *buffer) {
-    char *name; 
-
-    /** Check if the buffer contains a double quote character. */
-    if (strchr(buffer, '"')) {
-        /** Discard the first part of the string until the first double quote. */
-        strtok(buffer, "\""); 
-        /** Extract the token enclosed within double quotes. */
-        name = strtok(NULL, "\""); 
-    } else {
-        /** If there are no double quotes in the buffer, tokenize using the regular delimiter. */
-        name = strtok(buffer, DELIMITER); 
-    }
-
-    return name; 
+void share_hashtable(hashtable *ht) {
+    ht->shared = 1;
 }
 
 /** 
  * Calculates the hash value for the given key.
- * @param key The key for which to calculate the hash value.
+ * @param key The packed license plate for which to calculate the hash value.
  * @return The calculated hash value.
  */
-size_t hash_function(char *key) {
+size_t hash_function(plate key) {
 
-    /** Initial hash value with common prime number used for hashing. */
-    size_t hash = 5381; 
-    int c;
+    /** Multiply by the golden ratio so every character 
+     * affects the high bits, then fold them into the low ones. */
+    uint64_t hash = key * 0x9E3779B97F4A7C15ULL;
 
-    /** Iterate over each character in the key. */
-    while ((c = *key++) != '\0') {
-        /** Update the hash value using an algorithm. */
-        hash = ((hash << 5) + hash) + c; 
+    return (size_t)(hash ^ (hash >> 32)); 
+}
+
+/**
+ * Finds the value of a key in a table using linear probing, without locks:
+ * the keys are written once, before their values.
+ * @param table The table of entries.
+ * @param key The key to find.
+ * @param hash The hash value of the key.
+ * @return The value of the key, or NULL if it is not in the table
+ * (or it is still being inserted).
+ */
+static vehicle *probe_entries(entry_table *table, plate key, size_t hash) {
+    size_t mask = (size_t)table->length - 1;
+    size_t index = hash & mask;
+    plate current_key;
+
+    while ((current_key = __atomic_load_n(&table->entries[index].key, __ATOMIC_ACQUIRE)) != 
+        EMPTY_KEY) {
+        if (current_key == key) {
+            return __atomic_load_n(&table->entries[index].value, __ATOMIC_ACQUIRE);
+        }
+        index = (index + 1) & mask;
     }
 
-    return hash; 
+    return NULL;
 }
 
-/** 
- * Inserts a new entry(vehicle) into the hashtable.
- * @param ht Pointer to the hashtable.
- * @param key The key of the entry to be inserted.
- * @param value The value associated with the key.
+/**
+ * Claims the entry of a key in a table using linear probing. Each empty
+ * entry is claimed by a compare and swap of its key, so insertions on
+ * other threads only contend for the same entry.
+ * @param table The table of entries.
+ * @param key The key to insert.
+ * @param value The value of the key.
+ * @return The value stored, the one of another insertion of the key if any.
  */
-void insert_new_entry(hashtable *ht, char *key, vehicle *value) {
+static vehicle *claim_entry(entry_table *table, plate key, vehicle *value) {
+    size_t mask = (size_t)table->length - 1;
+    size_t index = hash_function(key) & mask;
     entry *current_entry;
+    plate current_key;
+    vehicle *stored;
+
+    while (1) {
+        current_entry = &table->entries[index];
+        current_key = __atomic_load_n(&current_entry->key, __ATOMIC_ACQUIRE);
+
+        if (current_key == EMPTY_KEY && __atomic_compare_exchange_n(&current_entry->key,
+            &current_key, key, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            /** The value is published after the key. */
+            __atomic_store_n(&current_entry->value, value, __ATOMIC_RELEASE);
+            return value;
+        }
 
-    /** Calculate hash index. */
-    size_t hash = hash_function(key) % ht->length; 
+        /** The key was inserted by another thread, wait for its value. */
+        if (current_key == key) {
+            while ((stored = __atomic_load_n(&current_entry->value, __ATOMIC_ACQUIRE)) == NULL) {
+                sched_yield();
+            }
+            return stored;
+        }
+        index = (index + 1) & mask;
+    }
+}
 
-    /** Get the entry at the hash index. */
-    current_entry = &ht->entries[hash]; 
+/**
+ * Retires a table once all its entries were moved: it is freed right
+ * away, or with the hashtable if lookups on other threads may still read it.
+ * @param ht Pointer to the hashtable.
+ * @param table Pointer to the table.
+ */
+static void retire_table(hashtable *ht, entry_table *table) {
+    if (ht->shared) {
+        table->next_retired = ht->retired;
+        ht->retired = table;
+    } else {
+        free_entry_table(table);
+    }
+}
 
-    /** If the entry is not empty, find the last entry in the list. */
-    /** Collision handling with lists. */
-    if (current_entry->key != NULL) {
-        while (current_entry->next != NULL) {
-            current_entry = current_entry->next;
+/**
+ * Moves entries of the old table to the grown one, retiring
+ * the old table once all were moved. Each entry is taken by one of 
+ * the threads inserting, the last one to finish retires the table.
+ * @param ht Pointer to the hashtable.
+ * @param table The grown table.
+ * @param count The max number of old entries to move.
+ */
+static void migrate_entries(hashtable *ht, entry_table *table, int count) {
+    entry_table *old = __atomic_load_n(&table->old, __ATOMIC_ACQUIRE);
+    entry *old_entry;
+    int index;
+
+    while (old != NULL && count-- > 0 &&
+        (index = __atomic_fetch_add(&table->migrated, 1, __ATOMIC_RELAXED)) < old->length) {
+        old_entry = &old->entries[index];
+
+        /** The old entry is kept, so the lookups still find it there. */
+        if (old_entry->key != EMPTY_KEY) {
+            claim_entry(table, old_entry->key, old_entry->value);
         }
-        /** Allocate memory for a new entry and move to it. */
-        if((current_entry->next = (entry *)malloc(sizeof(entry))) == NULL){
-            printf("Memory allocation for new entry failed\n");
+
+        if (__atomic_add_fetch(&table->moved, 1, __ATOMIC_ACQ_REL) == old->length) {
+            __atomic_store_n(&table->old, NULL, __ATOMIC_RELEASE);
+            retire_table(ht, old);
         }
-        current_entry = current_entry->next;
     }
+}
 
-    /** Initialize the new entry. */
-    current_entry->next = NULL;
-    if((current_entry->key = (char *)malloc(strlen(key) + 1)) == NULL){
-        printf("Memory allocation for new key failed\n");
-        return;
+/**
+ * Doubles the length of the hashtable. The entries are moved
+ * a few at a time on the next insertions instead of all at once.
+ * The grow lock must be held exclusively.
+ * @param ht Pointer to the hashtable.
+ * @return Returns 0 on success, -1 if the memory allocation failed.
+ */
+static int grow_hashtable(hashtable *ht) {
+    entry_table *new_table;
+
+    /** Finish moving the entries of a previous growth. */
+    while (ht->table->old != NULL) {
+        migrate_entries(ht, ht->table, ht->table->old->length);
+    }
+
+    if ((new_table = new_entry_table(ht->table->length * 2, ht->table)) == NULL) {
+        fprintf(stderr, "Memory allocation for grown hashtable failed\n");
+        return -1;
     }
-    strcpy(current_entry->key, key);
-    current_entry->value = value;
 
-    /** Increment the number of entries. */
-    ht->num_entries++; 
+    /** Lookups see the new table with its old one. */
+    __atomic_store_n(&ht->table, new_table, __ATOMIC_RELEASE);
 
+    return 0;
+}
+
+/** 
+ * Inserts a new entry(vehicle) into the hashtable. It may run on
+ * several threads at once, and with lookups on others.
+ * @param ht Pointer to the hashtable.
+ * @param key The key of the entry to be inserted.
+ * @param value The value associated with the key.
+ * @return The value of the key, the one inserted before by another 
+ * thread if any, or NULL if the hashtable is full.
+ */
+vehicle *insert_new_entry(hashtable *ht, plate key, vehicle *value) {
+    entry_table *table, *old;
+    vehicle *stored;
+
+    pthread_rwlock_rdlock(&ht->grow_lock);
+
+    /** Grow the hashtable if the max load would be exceeded. */
+    if ((__atomic_load_n(&ht->num_entries, __ATOMIC_RELAXED) + 1) * MAX_LOAD_DENOMINATOR > 
+        ht->table->length * MAX_LOAD_NUMERATOR) {
+        pthread_rwlock_unlock(&ht->grow_lock);
+        pthread_rwlock_wrlock(&ht->grow_lock);
+
+        /** Another thread may have grown it meanwhile. */
+        if ((ht->num_entries + 1) * MAX_LOAD_DENOMINATOR > 
+            ht->table->length * MAX_LOAD_NUMERATOR &&
+            grow_hashtable(ht) != 0 && ht->num_entries + 1 >= ht->table->length) {
+            pthread_rwlock_unlock(&ht->grow_lock);
+            return NULL;
+        }
+        pthread_rwlock_unlock(&ht->grow_lock);
+        pthread_rwlock_rdlock(&ht->grow_lock);
+    }
+    table = ht->table;
+
+    /** A key inserted before growing is moved, not inserted again. */
+    if ((old = __atomic_load_n(&table->old, __ATOMIC_ACQUIRE)) != NULL &&
+        (stored = probe_entries(old, key, hash_function(key))) != NULL) {
+        pthread_rwlock_unlock(&ht->grow_lock);
+        return stored;
+    }
+
+    /** Move a few old entries, so growing never stops everything. */
+    migrate_entries(ht, table, MIGRATION_STEP);
+
+    /** Claim the empty entry for the key. */
+    if ((stored = claim_entry(table, key, value)) == value) {
+        __atomic_add_fetch(&ht->num_entries, 1, __ATOMIC_RELAXED);
+    }
+
+    pthread_rwlock_unlock(&ht->grow_lock);
+    return stored;
 }
 
 
 /** 
- * Finds a vehicle in the hashtable by license plate.
+ * Finds a vehicle in the hashtable by license plate, without locks.
  * @param vehicles Pointer to the hashtable containing vehicle information.
  * @param license_plate The license plate of the vehicle to find.
  * @return Pointer to the found vehicle, or NULL if not found.
  */
-vehicle *find_vehicle(hashtable *vehicles, char *license_plate) {
-    size_t hash_index; 
-    entry *current_entry;
-
-    /** Calculate hash index. */
-    hash_index =  hash_function(license_plate) % vehicles->length;
-
-    /** Get the entry at the hash index. */
-    current_entry = &vehicles->entries[hash_index]; 
-
-    if (current_entry->key == NULL) {
-        return NULL; 
+vehicle *find_vehicle(hashtable *vehicles, plate license_plate) {
+    size_t hash = hash_function(license_plate);
+    entry_table *table, *old;
+    vehicle *found;
+
+    /** The old table is read first: once it is NULL all its entries
+     * are in the current table. */
+    table = __atomic_load_n(&vehicles->table, __ATOMIC_ACQUIRE);
+    old = __atomic_load_n(&table->old, __ATOMIC_ACQUIRE);
+
+    /** Look in the current entries. */
+    if ((found = probe_entries(table, license_plate, hash)) != NULL) {
+        return found;
     }
 
-    /** Iterate through the entries in the list at the hash index. */
-    while (current_entry != NULL) {
-        if (strcmp(current_entry->key, license_plate) == 0) {
-            /** Return the value if the key matches. */
-            return current_entry->value; 
-        }
-        current_entry = current_entry->next;
+    /** While growing, the entry may not have been moved yet. */
+    if (old != NULL) {
+        return probe_entries(old, license_plate, hash);
     }
 
     return NULL; 
@@ -174,71 +354,335 @@ vehicle *find_vehicle(hashtable *vehicles, char *license_plate) {
 
 
 /** 
- * Checks if a license plate is valid.
+ * Checks if a license plate is valid: three pairs separated by dashes,
+ * each pair with two upper case letters or two digits, and at least
+ * one pair of each kind. The 8 characters are classified into bit masks
+ * without branches, so the compiler can check them all at once.
  * @param license_plate The license plate to be validated.
  * @return 1 if the license plate is valid, otherwise 0.
  */
 int is_license_plate_valid(char *license_plate) {
-    int letter_count = 0, digit_count = 0;
+    unsigned int letters = 0, digits = 0, dashes = 0;
+    unsigned int letter_pairs, digit_pairs;
+    unsigned char character;
+    int i;
 
-    /** Check if the license plate has the correct format. */
-    if (strlen(license_plate) != 8 || license_plate[2] != '-' 
-        || license_plate[5] != '-')
+    /** Check if the license plate has the correct length. */
+    if (strnlen(license_plate, LICENSE_PLATE_SIZE) != LICENSE_PLATE_SIZE - 1)
         return 0;
 
-    /** Check each segment of the license plate. */
-    for (int i = 0; i < 8; i += 3) {
-        /** Check if each segment contains two letters or two digits. */
-        if ((isupper(license_plate[i]) && isupper(license_plate[i + 1])) ||
-            (isdigit(license_plate[i]) && isdigit(license_plate[i + 1]))) {
-
-            /** Count the number of letters and digits. */
-            if (isupper(license_plate[i])) {
-                letter_count++;
-            } else {
-                digit_count++;
-            }
-        } else {
-            return 0; 
+    /** Set the bit of each position with a letter, a digit or a dash. */
+    for (i = 0; i < LICENSE_PLATE_SIZE - 1; i++) {
+        character = (unsigned char)license_plate[i];
+        letters |= ((unsigned int)(character - 'A') < 26) << i;
+        digits |= ((unsigned int)(character - '0') < 10) << i;
+        dashes |= (character == '-') << i;
+    }
+
+    /** Count the pairs with two letters and the pairs with two digits. */
+    letter_pairs = ((letters & FIRST_PAIR_MASK) == FIRST_PAIR_MASK) +
+        ((letters & SECOND_PAIR_MASK) == SECOND_PAIR_MASK) +
+        ((letters & THIRD_PAIR_MASK) == THIRD_PAIR_MASK);
+    digit_pairs = ((digits & FIRST_PAIR_MASK) == FIRST_PAIR_MASK) +
+        ((digits & SECOND_PAIR_MASK) == SECOND_PAIR_MASK) +
+        ((digits & THIRD_PAIR_MASK) == THIRD_PAIR_MASK);
+
+    return ((dashes & DASHES_MASK) == DASHES_MASK) & 
+        (letter_pairs + digit_pairs == 3) & (letter_pairs >= 1) & (digit_pairs >= 1); 
+}
+
+/**
+ * Packs the 8 characters of a valid license plate in a single word.
+ * @param license_plate The license plate to pack.
+ * @return The packed license plate.
+ */
+plate pack_license_plate(char *license_plate) {
+    plate key;
+
+    memcpy(&key, license_plate, sizeof(key));
+    return key;
+}
+
+/**
+ * Adds a packed license plate to the output buffer.
+ * @param license_plate The packed license plate.
+ */
+void output_license_plate(plate license_plate) {
+    char characters[sizeof(plate)];
+
+    memcpy(characters, &license_plate, sizeof(plate));
+    output_bytes(characters, sizeof(plate));
+}
+
+/** Number of days of the year before each month (13 is the whole year). */
+static int days_before_month[DECEMBER + 2];
+
+/** Month of each day of the year. */
+static unsigned char month_of_day[DAYS_IN_YEAR + 1];
+
+/**
+ * Fills the calendar tables used to convert dates to timestamps and back.
+ */
+void initialize_calendar(void) {
+    int month, day, days = 0;
+
+    for (month = JANUARY; month <= DECEMBER + 1; month++) {
+        days_before_month[month] = days;
+        for (day = 1; day <= get_days_in_month(month); day++) {
+            month_of_day[days + day] = month;
         }
+        days += get_days_in_month(month);
     }
+}
+
+/**
+ * Parses a number the same way as scanf "%d".
+ * @param cursor Pointer to the position of the number, updated to the position after it.
+ * @param value Pointer to the parsed number.
+ * @return 1 if a number was found, otherwise 0.
+ */
+static int parse_number(char **cursor, int *value) {
+    char *current = *cursor;
+    int sign = 1, number = 0;
 
-    /** Check if there is at least one letter and one digit. */
-    if (letter_count < 1 || digit_count < 1)
+    /** Skip white space and the sign. */
+    while (*current == ' ' || (*current >= '\t' && *current <= '\r')) {
+        current++;
+    }
+    if (*current == '-' || *current == '+') {
+        sign = *current == '-' ? -1 : 1;
+        current++;
+    }
+    if (*current < '0' || *current > '9') {
         return 0;
+    }
+
+    /** Numbers too large for a date stop growing instead of overflowing. */
+    for (; *current >= '0' && *current <= '9'; current++) {
+        if (number < INT32_MAX / 10) {
+            number = number * 10 + (*current - '0');
+        }
+    }
+
+    *value = sign * number;
+    *cursor = current;
+    return 1;
+}
 
-    return 1; 
+/**
+ * Parses a number followed by a separator character.
+ * @param cursor Pointer to the position of the number, updated to the position after the separator.
+ * @param value Pointer to the parsed number.
+ * @param separator The character expected after the number.
+ * @return 1 if both were found, otherwise 0.
+ */
+static int parse_field(char **cursor, int *value, char separator) {
+    if (!parse_number(cursor, value) || **cursor != separator) {
+        return 0;
+    }
+    (*cursor)++;
+    return 1;
 }
 
 /**
  * Parses date and time from input strings and puts them in a date structure.
- * @param date_input The string containing date information.
- * @param time_input The string containing time information.
- * @return A pointer to the parsed date structure.
+ * @param date_input The string containing date information (dd-mm-yyyy).
+ * @param time_input The string containing time information (hh:mm), 
+ * if NULL the time is 00:00.
+ * @param parsed_date Pointer to the date structure to fill.
+ * @return 1 if all the fields were found, otherwise 0.
  */
-date *parse_date(char *date_input, char *time_input){
+int parse_date(char *date_input, char *time_input, date *parsed_date) {
 
-    date *entry_date; 
+    if (date_input == NULL || !parse_field(&date_input, &parsed_date->day, '-') ||
+        !parse_field(&date_input, &parsed_date->month, '-') ||
+        !parse_number(&date_input, &parsed_date->year)) {
+        return 0;
+    }
 
-    if((entry_date = (date *)malloc(sizeof(date)) ) == NULL){
-        printf("memory allocation for new date failed\n");
-        return NULL;
+    if (time_input == NULL) {
+        parsed_date->hour = 0;
+        parsed_date->minutes = 0;
+        return 1;
+    }
+
+    return parse_field(&time_input, &parsed_date->hour, ':') &&
+        parse_number(&time_input, &parsed_date->minutes);
+}
+
+/**
+ * Parses an amount of money in cents from its decimal digits, so it is
+ * exact. The digits after the cents round it to the nearest cent (half
+ * away from zero). Amounts above the largest cost saturate, and the
+ * other numbers atof reads (with an exponent, for example) are
+ * converted from their value.
+ * @param input The string with the amount, in units.
+ * @return The amount in cents, 0 if there is no number.
+ */
+money parse_money(char *input) {
+    char *cursor = input, *end;
+    money cents = 0, place = 10;
+    double value;
+    int negative;
+
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    negative = *cursor == '-';
+    if (*cursor == '-' || *cursor == '+') {
+        cursor++;
+    }
+
+    for (; isdigit((unsigned char)*cursor); cursor++) {
+        if (cents <= MAX_COST) {
+            cents = cents * 10 + (*cursor - '0') * 100;
+        }
+    }
+    if (*cursor == '.') {
+        for (cursor++; isdigit((unsigned char)*cursor); cursor++) {
+            if (place > 0) {
+                cents += (*cursor - '0') * place;
+                place /= 10;
+            } else if (place == 0) {
+                cents += *cursor >= '5';
+                place = -1;
+            }
+        }
+    }
+    if (cents > MAX_COST) {
+        cents = MAX_COST + 1;
+    }
+
+    /** Anything else atof would read is converted from the double. */
+    value = strtod(input, &end);
+    if (end != cursor) {
+        value *= 100;
+        if (!(fabs(value) <= MAX_COST)) {
+            return signbit(value) ? -(MAX_COST + 1) : MAX_COST + 1;
+        }
+        return llround(value);
+    }
+
+    return negative ? -cents : cents;
+}
+
+/** 
+ * Calculates the hash value of a parking name.
+ * @param name The name for which to calculate the hash value.
+ * @return The calculated hash value.
+ */
+size_t hash_name(char *name) {
+
+    /** Initial hash value with common prime number used for hashing. */
+    size_t hash = 5381; 
+    int c;
+
+    /** Iterate over each character in the name. */
+    while ((c = *name++) != '\0') {
+        /** Update the hash value using an algorithm. */
+        hash = ((hash << 5) + hash) + c; 
+    }
+
+    return hash; 
+}
+
+/**
+ * Finds the slot of the name index with the id of a parking.
+ * @param registry Pointer to the parking registry.
+ * @param name The name of the parking.
+ * @return Pointer to the slot with the id, or NULL if not found.
+ */
+static int *find_name_slot(parking_registry *registry, char *name) {
+    size_t mask = (size_t)registry->index_length - 1;
+    size_t index = hash_name(name) & mask;
+    int id;
+
+    /** Removed slots are skipped, the probing only stops at an empty one. */
+    while ((id = registry->name_index[index]) != EMPTY_SLOT) {
+        if (id != REMOVED_SLOT && strcmp(registry->parkings[id]->name, name) == 0) {
+            return &registry->name_index[index];
+        }
+        index = (index + 1) & mask;
+    }
+
+    return NULL;
+}
+
+/**
+ * Puts the id of a parking in the first free slot of the name index.
+ * @param registry Pointer to the parking registry.
+ * @param new_parking The parking to index.
+ */
+static void index_parking_name(parking_registry *registry, parking *new_parking) {
+    size_t mask = (size_t)registry->index_length - 1;
+    size_t index = hash_name(new_parking->name) & mask;
+
+    while (registry->name_index[index] >= 0) {
+        index = (index + 1) & mask;
     }
 
-    if(time_input == NULL){
-        sscanf(date_input, "%d-%d-%d", &(entry_date->day), 
-            &(entry_date->month), &(entry_date->year));
-        entry_date->hour = 0;
-        entry_date->minutes = 0;
-        return entry_date;
+    if (registry->name_index[index] == EMPTY_SLOT) {
+        registry->index_used++;
     }
+    registry->name_index[index] = new_parking->id;
+}
+
+/**
+ * Rebuilds the name index without the removed slots, 
+ * growing it so it is at most half full.
+ * @param registry Pointer to the parking registry.
+ * @return Returns 0 on success, -1 if the memory allocation failed.
+ */
+static int rebuild_name_index(parking_registry *registry) {
+    int i, length = registry->index_length;
+    int *new_index;
 
-    sscanf(date_input, "%d-%d-%d", &(entry_date->day), 
-        &(entry_date->month), &(entry_date->year));
-    sscanf(time_input, "%d:%d", &(entry_date->hour), 
-        &(entry_date->minutes));
+    while ((registry->num_parkings + 1) * 2 > length) {
+        length *= 2;
+    }
+
+    if ((new_index = (int *)tracked_malloc(sizeof(int) * length, ALLOC_REGISTRY)) == NULL) {
+        fprintf(stderr, "Memory allocation of parking name index failed\n");
+        return -1;
+    }
+    for (i = 0; i < length; i++) {
+        new_index[i] = EMPTY_SLOT;
+    }
+
+    tracked_free(registry->name_index, sizeof(int) * registry->index_length, ALLOC_REGISTRY);
+    registry->name_index = new_index;
+    registry->index_length = length;
+    registry->index_used = 0;
+
+    /** Index again the parkings that exist. */
+    for (i = 0; i < registry->num_parkings; i++) {
+        index_parking_name(registry, registry->sorted[i]);
+    }
+
+    return 0;
+}
+
+/**
+ * Finds the position of a name in the sorted parkings array.
+ * @param registry Pointer to the parking registry.
+ * @param name The name to find.
+ * @return The position of the parking with the name, or 
+ * where it would be inserted.
+ */
+static int find_sorted_position(parking_registry *registry, char *name) {
+    int low = 0, high = registry->num_parkings, middle;
+
+    /** Binary search by alphabetical order. */
+    while (low < high) {
+        middle = (low + high) / 2;
+        if (strcmp(registry->sorted[middle]->name, name) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
 
-    return entry_date;
+    return low;
 }
 
 /**
@@ -250,18 +694,105 @@ date *parse_date(char *date_input, char *time_input){
  */
 parking *find_parking(args *parking_args,char *name){
 
-    int i;
+    int *slot;
     if(name == NULL){
         return NULL;
     }
 
-    for (i =0; i <= parking_args->park_counter;i++){
-        if (parking_args->parkings[i] != NULL && 
-        strcmp(parking_args->parkings[i]->name, name) == 0) {
-            return parking_args->parkings[i];
+    slot = find_name_slot(&parking_args->registry, name);
+    if (slot == NULL) {
+        return NULL;
+    }
+    return parking_args->registry.parkings[*slot];
+}
+
+/**
+ * Adds a parking to the registry, giving it the next id.
+ * @param parking_args Pointer to the arguments structure 
+ * containing parking information.
+ * @param new_parking The parking to add.
+ * @return Returns 0 on success, -1 if the memory allocation failed.
+ */
+int add_parking_to_list(args *parking_args, parking *new_parking) {
+    parking_registry *registry = &parking_args->registry;
+    parking **new_parkings, **new_sorted;
+    int position;
+
+    /** Grow the parkings arrays if they are full. */
+    if (registry->num_ids == registry->capacity) {
+        if ((new_parkings = (parking **)tracked_realloc(registry->parkings, 
+            sizeof(parking *) * registry->capacity, sizeof(parking *) * registry->capacity * 2,
+            ALLOC_REGISTRY)) == NULL) {
+            fprintf(stderr, "Memory allocation of parkings failed\n");
+            return -1;
         }
+        registry->parkings = new_parkings;
+        if ((new_sorted = (parking **)tracked_realloc(registry->sorted, 
+            sizeof(parking *) * registry->capacity, sizeof(parking *) * registry->capacity * 2,
+            ALLOC_REGISTRY)) == NULL) {
+            fprintf(stderr, "Memory allocation of parkings failed\n");
+            return -1;
+        }
+        registry->sorted = new_sorted;
+        registry->capacity *= 2;
     }
-    return NULL;
+
+    /** Rebuild the name index if it would be more than 3/4 used. */
+    if ((registry->index_used + 1) * 4 > registry->index_length * 3 &&
+        rebuild_name_index(registry) != 0) {
+        return -1;
+    }
+
+    /** Give the parking the next id. */
+    new_parking->id = registry->num_ids++;
+    registry->parkings[new_parking->id] = new_parking;
+    index_parking_name(registry, new_parking);
+
+    /** Insert it in the sorted array. */
+    position = find_sorted_position(registry, new_parking->name);
+    memmove(&registry->sorted[position + 1], &registry->sorted[position],
+        sizeof(parking *) * (registry->num_parkings - position));
+    registry->sorted[position] = new_parking;
+    registry->num_parkings++;
+
+    return 0;
+}
+
+/**
+ * Checks if a parking was removed, as seen from a snapshot.
+ * @param my_parking The parking.
+ * @param snapshot Version of the snapshot, NO_VERSION for the latest state.
+ * @return 1 if it was removed before the snapshot, otherwise 0.
+ */
+int is_parking_removed(parking *my_parking, version snapshot) {
+    return __atomic_load_n(&my_parking->removed_version, __ATOMIC_ACQUIRE) < snapshot;
+}
+
+/**
+ * Checks if the exit of a log is seen from a snapshot.
+ * @param current_log The log.
+ * @param snapshot Version of the snapshot, NO_VERSION for the latest state.
+ * @return 1 if the vehicle left before the snapshot, otherwise 0.
+ */
+int is_exit_visible(vehicle_log *current_log, version snapshot) {
+    return __atomic_load_n(&current_log->exit_version, __ATOMIC_ACQUIRE) < snapshot;
+}
+
+/**
+ * Follows a link to a log of a history, as seen from a snapshot.
+ * @param link Pointer to the link (the first log of a history, or the
+ * next one of a log).
+ * @param snapshot Version of the snapshot, NO_VERSION for the latest state.
+ * @return Pointer to the log, or NULL if there is none before the snapshot.
+ */
+vehicle_log *get_visible_log(vehicle_log **link, version snapshot) {
+    vehicle_log *current_log = __atomic_load_n(link, __ATOMIC_ACQUIRE);
+
+    /** Logs are added in version order, so the next ones are newer too. */
+    if (current_log == NULL || current_log->entry_version >= snapshot) {
+        return NULL;
+    }
+    return current_log;
 }
 
 /**
@@ -270,10 +801,11 @@ parking *find_parking(args *parking_args,char *name){
  * @return 1 if the vehicle is parked, otherwise 0.
  */
 int is_vehicle_parked(vehicle *my_vehicle){
-    if(my_vehicle == NULL){
+    if(my_vehicle == NULL || !my_vehicle->is_parked){
         return 0;
     }
-    return my_vehicle->is_parked;
+    /** A vehicle in a removed parking not yet reclaimed is not parked. */
+    return !is_parking_removed(my_vehicle->last_history->my_parking, NO_VERSION);
 }
 
 /**
@@ -296,613 +828,844 @@ int get_days_in_month(int month) {
 }
 
 /**
- * Checks if a given date is later then the last date.
- * @param entry_date Pointer to the date structure to be checked.
- * @param parking_args Pointer to the arguments structure containing parking information.
- * @return 1 if the date is valid, otherwise 0.
+ * Checks if the fields of a date form a real date and time.
+ * @param my_date Pointer to the date structure to be checked.
+ * @return 1 if the date exists, otherwise 0.
  */
-int is_date_valid(date *entry_date, args *parking_args) {
-    int days_in_month;
-    days_in_month = get_days_in_month(entry_date->month);
+int is_calendar_date(date *my_date) {
+    int days_in_month = get_days_in_month(my_date->month);
 
-    if(days_in_month == 0){
+    if (days_in_month == 0 || my_date->day < 1 || my_date->day > days_in_month) {
         return 0;
     }
 
-    if (entry_date->day < 1 || entry_date->day > days_in_month){
+    if (my_date->year < 0 || my_date->year > MAX_YEAR) {
         return 0;
     }
 
-    if(entry_date->hour < 0 || entry_date->hour > 23  || entry_date->minutes < 0 
-    || entry_date->minutes > 59){
-        return 0;
-    }
+    return my_date->hour >= 0 && my_date->hour <= 23 &&
+        my_date->minutes >= 0 && my_date->minutes <= 59;
+}
 
-    if (parking_args->last_date.minutes == -1) {
-        parking_args->last_date = *entry_date;
-        return 1;
+/**
+ * Calculates the total number of minutes of a date, which is its timestamp 
+ * if the date exists. Dates with a month after December count the whole 
+ * year, like in the original minute count.
+ * @param my_date Pointer to the date structure.
+ * @return The total number of minutes of the date.
+ */
+long long get_all_minutes(date *my_date) {
+    int month = my_date->month;
+
+    if (month < JANUARY) {
+        month = JANUARY;
+    } else if (month > DECEMBER + 1) {
+        month = DECEMBER + 1;
     }
-    
-    if (parking_args->last_date.year > entry_date->year)
-        return 0;
 
-    if (parking_args->last_date.year == entry_date->year &&
-        parking_args->last_date.month > entry_date->month)
-        return 0;
+    return ((long long)my_date->year * DAYS_IN_YEAR + days_before_month[month] +
+        my_date->day) * MINUTES_IN_DAY + my_date->hour * 60 + my_date->minutes;
+}
 
-    if (parking_args->last_date.year == entry_date->year &&
-        parking_args->last_date.month == entry_date->month &&
-        parking_args->last_date.day > entry_date->day)
-        return 0;
+/**
+ * Splits a timestamp in the fields of a date.
+ * @param time The timestamp.
+ * @param my_date Pointer to the date structure to fill.
+ */
+void get_date_fields(timestamp time, date *my_date) {
+    int days = time / MINUTES_IN_DAY, day_of_year;
+
+    /** Days start at 1, so the last day of a year is a multiple of 365. */
+    my_date->year = (days - 1) / DAYS_IN_YEAR;
+    day_of_year = days - my_date->year * DAYS_IN_YEAR;
+    my_date->month = month_of_day[day_of_year];
+    my_date->day = day_of_year - days_before_month[my_date->month];
+    my_date->hour = time % MINUTES_IN_DAY / 60;
+    my_date->minutes = time % 60;
+}
+
+/**
+ * Adds the day of a timestamp to the output buffer (dd-mm-yyyy).
+ * @param time The timestamp.
+ */
+void output_day(timestamp time) {
+    date my_date;
 
-    if (parking_args->last_date.year == entry_date->year &&
-        parking_args->last_date.month == entry_date->month &&
-        parking_args->last_date.day == entry_date->day &&
-        parking_args->last_date.hour > entry_date->hour)
+    get_date_fields(time, &my_date);
+    output_date(my_date.day, my_date.month, my_date.year);
+}
+
+/**
+ * Adds the time of a timestamp to the output buffer (hh:mm).
+ * @param time The timestamp.
+ */
+void output_hour(timestamp time) {
+    output_time(time % MINUTES_IN_DAY / 60, time % 60);
+}
+
+/**
+ * Adds a timestamp to the output buffer (dd-mm-yyyy hh:mm).
+ * @param time The timestamp.
+ */
+void output_timestamp(timestamp time) {
+    output_day(time);
+    output_char(' ');
+    output_hour(time);
+}
+
+/**
+ * Checks if a given date is later then the last date, 
+ * recording it as the last date if it is.
+ * @param entry_date Pointer to the date structure to be checked.
+ * @param parking_args Pointer to the arguments structure containing parking information.
+ * @return 1 if the date is valid, otherwise 0.
+ */
+int is_date_valid(date *entry_date, args *parking_args) {
+    timestamp time;
+
+    if (!is_calendar_date(entry_date)) {
         return 0;
+    }
 
-    if (parking_args->last_date.year == entry_date->year &&
-        parking_args->last_date.month == entry_date->month &&
-        parking_args->last_date.day == entry_date->day &&
-        parking_args->last_date.hour == entry_date->hour &&
-        parking_args->last_date.minutes > entry_date->minutes)
+    time = (timestamp)get_all_minutes(entry_date);
+    if (parking_args->last_date != NO_DATE && time < parking_args->last_date) {
         return 0;
-    
-    parking_args->last_date = *entry_date;
+    }
+
+    parking_args->last_date = time;
     return 1;
 }
 
 /**
- * Calculates the total number of minutes between two dates.
- * @param entry_date The entry date.
- * @param exit_date The exit date.
- * @return The total number of minutes between the entry and exit dates.
+ * Creates a tariff, filling its charges for each number of periods of
+ * a stay after its whole days.
+ * @param effective_date First exit date the tariff charges.
+ * @param X Cost of each period of the first hour, in cents.
+ * @param Y Cost of each period after the first hour, in cents.
+ * @param Z Max cost of a day, in cents.
+ * @return Pointer to the tariff, not in any parking, or NULL if it
+ * could not be allocated.
  */
-int get_all_minutes(date *entry_date, date *exit_date){
+tariff *create_tariff(timestamp effective_date, money X, money Y, money Z) {
+    tariff *new_tariff;
+    money remaining_cost;
+    int periods;
 
-    int entry_minutes, exit_minutes, total_minutes, i;
+    if ((new_tariff = (tariff *)tracked_malloc(sizeof(tariff), ALLOC_PARKING)) == NULL) {
+        return NULL;
+    }
+    new_tariff->effective_date = effective_date;
+    new_tariff->cost_x = X;
+    new_tariff->cost_y = Y;
+    new_tariff->cost_z = Z;
+    new_tariff->next = NULL;
+
+    for (periods = 0; periods <= PERIODS_IN_DAY; periods++) {
+
+        /** If there is more then 4 periods (first hour), multiply 
+         * the first four by the X cost 
+         * and the rest by the Y value(after the first hour).
+        */
+        if (periods > PERIODS_IN_FIRST_HOUR) {
+            remaining_cost = PERIODS_IN_FIRST_HOUR * X + (periods - PERIODS_IN_FIRST_HOUR) * Y;
+        } else {
+            remaining_cost = periods * X;
+        }
 
-    /** Calculate total minutes for entry date. */
-    entry_minutes = entry_date->hour * 60 + entry_date->minutes + 
-    entry_date->day * 24 * 60 + entry_date->year * 365 * 24 * 60;
-    for (i = 1; i < entry_date->month; i++) {
-        entry_minutes += get_days_in_month(i) * 24 * 60;
+        /** Compare remaining cost with daily cost(Z) so it doesn't exceed the limit. */
+        new_tariff->charges[periods] = remaining_cost < Z ? remaining_cost : Z;
     }
+    return new_tariff;
+}
+
+/**
+ * Adds a tariff to a parking, before the ones in effect from an older
+ * date, and before one in effect from the same date, which it replaces.
+ * @param current_parking The parking.
+ * @param new_tariff The tariff.
+ */
+void insert_tariff(parking *current_parking, tariff *new_tariff) {
+    tariff **link = &current_parking->tariffs;
 
-    /** Calculate total minutes for exit date. */
-    exit_minutes = exit_date->hour * 60 + exit_date->minutes + 
-    exit_date->day * 24 * 60 + exit_date->year * 365 * 24 * 60;
-    for (i = 1; i < exit_date->month; i++) {
-        exit_minutes += get_days_in_month(i) * 24 * 60;
+    while (*link != NULL && (*link)->effective_date > new_tariff->effective_date) {
+        link = &(*link)->next;
     }
+    new_tariff->next = *link;
+    *link = new_tariff;
+}
 
-    /** Calculate the difference between entry and exit dates. */
-    total_minutes = exit_minutes - entry_minutes;
+/**
+ * Finds the tariff of a parking in effect at a date, usually the newest.
+ * @param current_parking The parking.
+ * @param exit_date The date.
+ * @return Pointer to the tariff.
+ */
+tariff *find_tariff(parking *current_parking, timestamp exit_date) {
+    tariff *current_tariff = current_parking->tariffs;
 
-    return total_minutes;
+    /** The tariff of the creation is in effect from the first date. */
+    while (current_tariff->effective_date > exit_date) {
+        current_tariff = current_tariff->next;
+    }
+    return current_tariff;
 }
 
 /**
- * Calculates the parking cost based on the duration of parking and said costs.
+ * Calculates the parking cost based on the duration of parking and the
+ * tariff in effect at the exit.
  * @param current_parking The current parking.
  * @param current_log The vehicle log containing entry and exit dates.
- * @return The total cost od staying in the park.
+ * @return The total cost od staying in the park, in cents.
  */
-double calculate_cost(parking *current_parking, vehicle_log *current_log){
+money calculate_cost(parking *current_parking, vehicle_log *current_log){
+    tariff *prices = find_tariff(current_parking, current_log->exit_date);
 
-    double X = current_parking->cost_x;
-    double Y = current_parking->cost_y;
-    double Z = current_parking->cost_z;
-    double remaining_cost = 0.0;
-    double total_cost = 0.0;
-    int minutes, days, remaining_minutes, remaining_periods;
+    /** Calculate total minutes and whole days parked. */
+    uint32_t minutes = current_log->exit_date - current_log->entry_date;
+    uint32_t days = minutes / MINUTES_IN_DAY;
 
-    /** Calculate total minutes parked. */
-    minutes = get_all_minutes(current_log->entry_date, current_log->exit_date);
+    /** The full days at the daily cost, and the charge of the periods after them. */
+    return days * prices->cost_z + prices->charges[
+        (minutes - days * MINUTES_IN_DAY + MINUTES_IN_PERIOD - 1) / MINUTES_IN_PERIOD];
+}
 
-    /** Calculate total days parked. */
-    days = minutes / (24 * 60);
+/**
+ * Calculates the costs of many stays with a tariff, the same as
+ * calculate_cost. Each block of stays is first split in days and
+ * periods by a loop without branches, which the compiler vectorizes,
+ * and then priced with the charges.
+ * @param prices The tariff.
+ * @param entry_dates The entry dates of the stays.
+ * @param exit_dates The exit dates of the stays, not before the entries.
+ * @param costs The costs of the stays in cents, calculated.
+ * @param count Number of stays.
+ */
+void calculate_costs(tariff *prices, const timestamp *entry_dates,
+    const timestamp *exit_dates, money *costs, int count) {
+    uint32_t days[PRICING_BLOCK], periods[PRICING_BLOCK], minutes;
+    const money *charges = prices->charges;
+    money daily_cost = prices->cost_z;
+    int first, length, i;
+
+    for (first = 0; first < count; first += PRICING_BLOCK) {
+        length = count - first < PRICING_BLOCK ? count - first : PRICING_BLOCK;
+
+        for (i = 0; i < length; i++) {
+            minutes = exit_dates[first + i] - entry_dates[first + i];
+            days[i] = minutes / MINUTES_IN_DAY;
+            periods[i] = (minutes - days[i] * MINUTES_IN_DAY + MINUTES_IN_PERIOD - 1) /
+                MINUTES_IN_PERIOD;
+        }
+        for (i = 0; i < length; i++) {
+            costs[first + i] = days[i] * daily_cost + charges[periods[i]];
+        }
+    }
+}
 
-    /** Calculate the remaining minutes after the whole days*/
-    remaining_minutes = minutes % (24 * 60);
+/**
+ * Finds the history of a vehicle in a parking, adding it in name order 
+ * if the vehicle was never there.
+ * @param my_vehicle The vehicle.
+ * @param current_parking The parking.
+ * @return Pointer to the history, or NULL if it could not be allocated.
+ */
+parking_history *find_parking_history(vehicle *my_vehicle, parking *current_parking) {
+    parking_history *current, *prev = NULL, *new_history;
+    int comparison = 1;
+
+    /** Most entries are in the parking of the last one. */
+    if (my_vehicle->last_history != NULL && 
+        my_vehicle->last_history->my_parking == current_parking) {
+        return my_vehicle->last_history;
+    }
 
-    /** Add the cost of the full days. */
-    total_cost += days * Z;
+    /** Find the first history with a name not before the parking name,
+     * skipping the ones of removed parkings not yet reclaimed. */
+    current = my_vehicle->histories;
+    while (current != NULL && (is_parking_removed(current->my_parking, NO_VERSION) ||
+        (comparison = strcmp(current->my_parking->name, current_parking->name)) < 0)) {
+        prev = current;
+        current = current->next;
+    }
 
-    /** Calculate remaining quarter periods. */
-    remaining_periods = (remaining_minutes + 14) / 15;
+    /** Names of existing parkings are unique. */
+    if (current != NULL && comparison == 0) {
+        return current;
+    }
 
-    /** If there is more then 4 periods (first hour), multiply 
-     * the first four by the X cost 
-     * and the rest by the Y value(after the first hour).
-    */
-    if (remaining_periods > 4) {
-        remaining_cost = 4 * X + (remaining_periods - 4) * Y;
-    } else {
-        remaining_cost = remaining_periods * X;
+    /** Get a new history from the parking pool and link it. */
+    if ((new_history = (parking_history *)pool_alloc(&current_parking->history_pool)) == NULL) {
+        return NULL;
+    }
+    new_history->my_parking = current_parking;
+    new_history->my_vehicle = my_vehicle;
+    new_history->first_log = NULL;
+    new_history->last_log = NULL;
+    new_history->next = current;
+    new_history->prev = prev;
+    if (current != NULL) {
+        current->prev = new_history;
     }
 
-    /** Compare remaining cost with daily cost(Z) so it doesn't exceed the limit. */
-    if (remaining_cost < Z) {
-        total_cost += remaining_cost;
+    /** Link it complete, snapshots may be reading the histories. */
+    if (prev == NULL) {
+        __atomic_store_n(&my_vehicle->histories, new_history, __ATOMIC_RELEASE);
     } else {
-        total_cost += Z;
+        __atomic_store_n(&prev->next, new_history, __ATOMIC_RELEASE);
     }
 
-    return total_cost;
+    /** The parking also keeps it, so it can be removed without a search. */
+    new_history->next_in_parking = current_parking->histories;
+    current_parking->histories = new_history;
+
+    return new_history;
 }
 
 /**
- * Sorts an array of strings in lexicographical order using insertion sort.
- * @param array The array of strings to be sorted.
- * @param num_elements The number of elements in the array.
+ * Adds a new vehicle, not parked, to the hashtable.
+ * @param vehicles The hashtable of the vehicles.
+ * @param license_plate The packed license plate of the vehicle.
+ * @return Pointer to the vehicle, or NULL if it could not be allocated.
  */
-void insertion_sort(char **array, int num_elements) {
-    int i, j;
-    char *key;
-    for (i = 1; i < num_elements; i++) {
-        key = array[i];
-        j = i - 1;
+vehicle *add_new_vehicle(hashtable *vehicles, plate license_plate) {
+    vehicle *my_vehicle;
 
-        /** Move elements of array[0..i-1], that are greater than key, 
-         * to one position ahead of their current position. 
-        */
-        while (j >= 0 && strcmp(array[j], key) > 0) {
-            array[j + 1] = array[j];
-            j = j - 1;
-        }
-        array[j + 1] = key;
+    if ((my_vehicle = (vehicle *)pool_alloc(&vehicles->vehicle_pool)) == NULL) {
+        return NULL;
     }
+    my_vehicle->license_plate = license_plate;
+    my_vehicle->parking_id = NO_PARKING;
+    my_vehicle->is_parked = 0;
+    my_vehicle->histories = NULL;
+    my_vehicle->last_history = NULL;
+    insert_new_entry(vehicles, license_plate, my_vehicle);
+
+    return my_vehicle;
 }
 
 /**
- * Adds a new log entry for a vehicle parked in a parking.
- * @param my_vehicle The vehicle being parked.
- * @param current_parking The parking where the vehicle is parked.
+ * Appends a new log, still open, to the history of a vehicle in a parking.
+ * @param history The history of the vehicle in the parking.
  * @param entry_date The entry date of the vehicle.
- * @param name The name of the parking.
+ * @param entry_version The version of the entry.
+ * @return Pointer to the log, or NULL if it could not be allocated.
  */
-void add_new_log(vehicle *my_vehicle, parking *current_parking, date *entry_date, char *name){
+vehicle_log *append_vehicle_log(parking_history *history, timestamp entry_date,
+    version entry_version) {
     vehicle_log *new_log;
 
-    /** Allocate memory for the new vehicle log, */
-    if((new_log = (vehicle_log*)malloc(sizeof(vehicle_log))) == NULL){
-        fprintf(stderr, "Memory allocation for new log failed\n");
-        return;
+    /** Get a new vehicle log from the parking pool. */
+    if((new_log = (vehicle_log*)pool_alloc(&history->my_parking->log_pool)) == NULL){
+        return NULL;
     }
 
     /** Initialize it. */
     new_log->entry_date = entry_date;
-    new_log->exit_date = NULL;
-    new_log->cost = 0.0;
-
-    /** Allocate memory for license plate and copy the value. */
-    if((new_log->license_plate = (char *)malloc(strlen(my_vehicle->license_plate) + 1)) == NULL){
-        fprintf(stderr, "Memory allocation for license plate failed\n");
-        return;
+    new_log->exit_date = NO_DATE;
+    new_log->entry_version = entry_version;
+    new_log->exit_version = NO_VERSION;
+    new_log->cost = 0;
+    new_log->next_in_day = NULL;
+    new_log->next = NULL;
+
+    new_log->license_plate = history->my_vehicle->license_plate;
+
+    /** Link it complete, snapshots may be reading the logs. */
+    if (history->first_log == NULL) {
+        /** If there are no logs in the parking, set the new log as the first and last log. */
+        __atomic_store_n(&history->first_log, new_log, __ATOMIC_RELEASE);
+    } else {
+        /** If there are existing logs, set the new log as the last log. */
+        __atomic_store_n(&history->last_log->next, new_log, __ATOMIC_RELEASE);
     }
-    strcpy(new_log->license_plate, my_vehicle->license_plate);
+    history->last_log = new_log;
 
-    /** Allocate memory for parking name and copy the value. */
-    if((new_log->parking_name = (char *)malloc(strlen(name) + 1)) == NULL){
-        fprintf(stderr, "Memory allocation for parking name failed\n");
-        return;
-    }
-    strcpy(new_log->parking_name, name);
+    return new_log;
+}
 
-    if (my_vehicle->my_logs == NULL) {
-        /** If there are no logs for the vehicle, set the new log as the first and last log. */
-        new_log->next = NULL;
-        my_vehicle->my_logs = new_log;
-        my_vehicle->my_last_log = new_log;
+/**
+ * Adds a new log entry for a vehicle parked in a parking.
+ * @param history The history of the vehicle in the parking where it is parked.
+ * @param entry_date The entry date of the vehicle.
+ * @param free_spaces The free spaces of the parking after the entry.
+ * @param entry_version The version of the entry.
+ */
+void add_new_log(parking_history *history, timestamp entry_date, int free_spaces,
+    version entry_version){
+    parking *current_parking = history->my_parking;
 
-    } else {
-        /** If there are existing logs, set the new log as the last log. */
-        new_log->next = NULL;
-        my_vehicle->my_last_log->next = new_log;
-        my_vehicle->my_last_log = new_log;
+    if (append_vehicle_log(history, entry_date, entry_version) == NULL) {
+        fprintf(stderr, "Memory allocation for new log failed\n");
+        return;
     }
 
-    printf("%s %d\n", current_parking->name, current_parking->free_spaces);  
+    output_string(current_parking->name);
+    output_char(' ');
+    output_int(free_spaces);
+    output_char('\n');  
 }
 
 /**
- * Compares two dates.
+ * Compares the days of two dates.
  * @param date_1 The first date.
  * @param date_2 The second date.
- * @return 0 if the dates are equal, 1 if date_1 is greater, -1 if date_2 is greater.
+ * @return 0 if the days are equal, 1 if date_1 is greater, -1 if date_2 is greater.
  */
-int compare_dates(date *date_1, date *date_2) {
+int compare_dates(timestamp date_1, timestamp date_2) {
+    timestamp day_1 = date_1 / MINUTES_IN_DAY, day_2 = date_2 / MINUTES_IN_DAY;
 
-    if (date_1 == NULL) {
-        /** date_2 is considered greater. */
-        return 1; 
-    }
+    return (day_1 > day_2) - (day_1 < day_2);
+}
 
-    if (date_2 == NULL) {
-        /** date_1 is considered greater. */
-        return -1; 
+/**
+ * Grows the billing days array of a parking. While snapshots may read
+ * the parking the old array is kept, until the parking is freed.
+ * @param current_parking The parking.
+ * @param new_capacity The new capacity of the array.
+ * @return 0 on success, -1 if the memory could not be allocated.
+ */
+static int grow_billing_days(parking *current_parking, int new_capacity) {
+    billing_day *new_days = NULL;
+    replaced_days *replaced;
+
+    if (current_parking->shared && current_parking->billing_days != NULL) {
+        if ((new_days = (billing_day *)tracked_malloc(sizeof(billing_day) * new_capacity,
+            ALLOC_BILLING_DAY)) == NULL || (replaced = (replaced_days *)tracked_malloc(
+            sizeof(replaced_days), ALLOC_BILLING_DAY)) == NULL) {
+            tracked_free(new_days, sizeof(billing_day) * new_capacity, ALLOC_BILLING_DAY);
+            return -1;
+        }
+        memcpy(new_days, current_parking->billing_days,
+            sizeof(billing_day) * current_parking->num_billing_days);
+        replaced->billing_days = current_parking->billing_days;
+        replaced->billing_capacity = current_parking->billing_capacity;
+        replaced->next = current_parking->replaced;
+        current_parking->replaced = replaced;
+    } else if ((new_days = (billing_day *)tracked_realloc(current_parking->billing_days,
+        sizeof(billing_day) * current_parking->billing_capacity,
+        sizeof(billing_day) * new_capacity, ALLOC_BILLING_DAY)) == NULL) {
+        return -1;
     }
 
-    /** Compare year, month, and day. */
-    if (date_1->year == date_2->year && date_1->month == date_2->month 
-    && date_1->day == date_2->day ){
-        return 0; 
-    }
-    
-    return get_all_minutes(date_1, date_2);
+    __atomic_store_n(&current_parking->billing_days, new_days, __ATOMIC_RELEASE);
+    current_parking->billing_capacity = new_capacity;
+    return 0;
 }
 
 /**
- * Adds a new exit revenue record for a vehicle in a parking..
+ * Adds the log of an exit to the billing days of a parking.
  * @param current_parking The parking where the vehicle was parked.
- * @param exit_date The exit date of the vehicle.
- * @param cost The cost of parking for the vehicle.
- * @param my_vehicle The vehicle that exited.
+ * @param exit_log The log of the vehicle, with its exit date and cost.
  */
-void add_new_billing_day(parking *current_parking, date *exit_date, double cost, vehicle *my_vehicle){
+void add_new_billing_day(parking *current_parking, vehicle_log *exit_log){
 
-    billing_day *current_log = current_parking->last_billing_day_log;
-    billing_day *new_exit;
-    vehicle_log *new_log;
+    billing_day *current_log = NULL;
+    int new_capacity;
+
+    /** The log is shared with the vehicle, it is the last one of the day. */
+    exit_log->next_in_day = NULL;
+
+    if (current_parking->num_billing_days > 0) {
+        current_log = &current_parking->billing_days[current_parking->num_billing_days - 1];
+    }
 
     /** If the exit date is greater than the current latest exit date add 
      * a new billing day . 
     */
-    if (compare_dates(current_log->exit_date, exit_date) != 0 ){
-
-        /** Allocate memory for a new billing day entry. */
-        if ((new_exit = (billing_day*)malloc(sizeof(billing_day))) == NULL) {
-            fprintf(stderr, "Memory allocation for new billing day failed");
-            return;
-        }
-        
-        /** Allocate memory for the exit date and copy its value. */
-        if ((new_exit->exit_date = (date*)malloc(sizeof(date))) == NULL) {
-            fprintf(stderr, "Memory allocation for exit date failed");
-            free(new_exit);
-            return;
-        }
-        memcpy(new_exit->exit_date, exit_date, sizeof(date));
-
-        /** Allocate memory for the vehicle log. */
-        if (( new_log = (vehicle_log*)malloc(sizeof(vehicle_log)))== NULL) {
-            fprintf(stderr, "Memory allocation for new log failed");
-            free(new_exit->exit_date);
-            free(new_exit);
-            return;
+    if (current_log == NULL || compare_dates(current_log->exit_date, exit_log->exit_date) != 0) {
+
+        /** Double the billing days array if it is full. */
+        if (current_parking->num_billing_days == current_parking->billing_capacity) {
+            new_capacity = current_parking->billing_capacity > 0 ? 
+                current_parking->billing_capacity * 2 : INITIAL_BILLING_DAYS;
+            if (grow_billing_days(current_parking, new_capacity) != 0) {
+                fprintf(stderr, "Memory allocation for new billing day failed");
+                return;
+            }
         }
 
-        /** Allocate memory for exit_date. */
-        if ((new_log->exit_date = (date*)malloc(sizeof(date))) == NULL) {
-            fprintf(stderr, "Memory allocation for exit date failed");
-            free(new_log);
-            free(new_exit->exit_date);
-            free(new_exit);
-            return;
+        /** Dates only go forward, so the array stays sorted. */
+        current_log = &current_parking->billing_days[current_parking->num_billing_days];
+        current_log->exit_date = exit_log->exit_date;
+        current_log->total_cost = exit_log->cost;
+        current_log->cumulative_cost = exit_log->cost;
+        if (current_parking->num_billing_days > 0) {
+            current_log->cumulative_cost += current_log[-1].cumulative_cost;
         }
+        current_log->vehicle_log = exit_log;
+        current_log->last_vehicle_log = exit_log;
 
-        memcpy(new_log->exit_date, exit_date, sizeof(date));
-
-        /** Allocate memory for license plate and copy the value. */
-        if ((new_log->license_plate = (char *)malloc(strlen(my_vehicle->license_plate) + 1)) == NULL) {
-            fprintf(stderr, "Memory allocation for license plate failed");
-            free(new_log->exit_date);
-            free(new_exit->exit_date);
-            free(new_exit);
-            free(new_log);
-            return;
-        }
-        strcpy(new_log->license_plate, my_vehicle->license_plate);
-
-        /** Set the cost. */
-        new_log->cost = cost;
-        new_log->entry_date = NULL;
-        new_log->parking_name = NULL;
-        new_log->next = NULL;
-        new_exit->total_cost = cost;
-        new_exit->next = NULL;
-
-        /** Update pointers. */
-        current_parking->last_billing_day_log->next = new_exit;
-        current_parking->last_billing_day_log = new_exit;
-        new_exit->vehicle_log = new_log;
-        new_exit->last_vehicle_log = new_log;
+        /** Count it once complete, snapshots may be reading the days. */
+        __atomic_store_n(&current_parking->num_billing_days,
+            current_parking->num_billing_days + 1, __ATOMIC_RELEASE);
     }
     else {
         /** If the exit date is the same as the last recorded billing day we 
          * just add the cost 
-         * to the existing billing day and a new vehicle log.
+         * to the existing billing day and link the log.
         */
+        __atomic_store_n(&current_log->last_vehicle_log->next_in_day, exit_log,
+            __ATOMIC_RELEASE);
+        current_log->last_vehicle_log = exit_log;
+        current_log->total_cost += exit_log->cost;
+        current_log->cumulative_cost += exit_log->cost;
+    }
+}
 
-        /** Allocate memory for the vehicle log. */
-        if ((new_log = (vehicle_log*)malloc(sizeof(vehicle_log))) == NULL) {
-            fprintf(stderr, "Memory allocation for new log failed\n");
-            return;
-        }
-        
-        if ((new_log->exit_date = (date*)malloc(sizeof(date))) == NULL) {
-            fprintf(stderr, "Memory allocation for exit date failed\n");
-            free(new_log);
-            return;
-        }
-        memcpy(new_log->exit_date, exit_date, sizeof(date));
-
-        /** Allocate memory for license plate and copy the value. */
-        new_log->license_plate = (char *)malloc(strlen(my_vehicle->license_plate) + 1);
-        if (new_log->license_plate == NULL) {
-            fprintf(stderr, "%s: Memory allocation for license failed\n",my_vehicle->license_plate );
-            free(new_log->exit_date);
-            free(new_log);
-            return;
-        }
-        strcpy(new_log->license_plate, my_vehicle->license_plate);
+/**
+ * Finds the position of the first of some billing days not before a
+ * given day, using binary search.
+ * @param days The billing days, sorted by date.
+ * @param count Number of billing days.
+ * @param day_date Any date of the day.
+ * @return The position, count if all the days are before it.
+ */
+static int search_billing_days(billing_day *days, int count, timestamp day_date) {
+    int low = 0, high = count, middle;
 
-        /** Set the cost and update the total cost for that day. */
-        new_log->cost = cost;
-        new_log->entry_date = NULL;
-        new_log->next = NULL;
-        new_log->parking_name = NULL;
-        current_log->last_vehicle_log->next = new_log;
-        current_log->last_vehicle_log = new_log;
-        current_log->total_cost += cost;
+    while (low < high) {
+        middle = low + (high - low) / 2;
+        if (compare_dates(days[middle].exit_date, day_date) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
     }
+
+    return low;
 }
 
 /**
- * Adds a new exit revenue record for a vehicle in a parking..
- * @param current_parking The parking where the vehicle was parked.
- * @param exit_date The exit date of the vehicle.
- * @param cost The cost of parking for the vehicle.
- * @param my_vehicle The vehicle that exited.
+ * Finds the position of the first billing day of a parking 
+ * not before a given day, using binary search.
+ * @param current_parking The parking.
+ * @param day_date Any date of the day.
+ * @return The position, num_billing_days if all the days are before it.
  */
-void add_new_exit(parking *current_parking, date *exit_date, double cost, vehicle *my_vehicle){
+int find_billing_position(parking *current_parking, timestamp day_date) {
+    return search_billing_days(current_parking->billing_days,
+        current_parking->num_billing_days, day_date);
+}
 
-    billing_day *new_exit; 
-    vehicle_log *new_log;
+/**
+ * Gets the billing days of a parking seen from a snapshot.
+ * @param current_parking The parking.
+ * @param snapshot Version of the snapshot.
+ * @param days Pointer to set to the billing days.
+ * @return Number of billing days of the snapshot.
+ */
+int get_visible_days(parking *current_parking, version snapshot, billing_day **days) {
+    int count = __atomic_load_n(&current_parking->num_billing_days, __ATOMIC_ACQUIRE);
 
-    /** Check if any of the parameters is NULL. */
-    if (current_parking == NULL || exit_date == NULL || my_vehicle == NULL) {
-        return;
+    *days = __atomic_load_n(&current_parking->billing_days, __ATOMIC_ACQUIRE);
+
+    /** Days are added in version order, the last ones may be newer. */
+    while (count > 0 && !is_exit_visible((*days)[count - 1].vehicle_log, snapshot)) {
+        count--;
     }
+    return count;
+}
 
-    /** If there are no existing billing day logs for the parking. */
-    if (current_parking->billing_day_log == NULL) {
+/**
+ * Gets the total cost of a billing day seen from a snapshot.
+ * @param day The billing day.
+ * @param is_last Flag indicating it is the last day of the snapshot,
+ * the only one whose total may include newer exits.
+ * @param snapshot Version of the snapshot.
+ * @return The total cost, in cents.
+ */
+money get_day_total(billing_day *day, int is_last, version snapshot) {
+    vehicle_log *current_log;
+    money total = 0;
 
-        /** Allocate memory for a new billing day entry. */
-        if((new_exit = (billing_day*)malloc(sizeof(billing_day)))==NULL){
-            fprintf(stderr,"Memory allocation for billing log failed\n");
-            return;
-        }
+    if (!is_last || snapshot == NO_VERSION) {
+        return day->total_cost;
+    }
 
-        /** Allocate memory for the exit date and copy its value. */
-        if ((new_exit->exit_date = (date*)malloc(sizeof(date))) == NULL) {
-            fprintf(stderr,"Memory allocation for exit date failed\n");
-            free(new_exit);
-            return;
-        }
+    for (current_log = day->vehicle_log; current_log != NULL &&
+        is_exit_visible(current_log, snapshot);
+        current_log = __atomic_load_n(&current_log->next_in_day, __ATOMIC_ACQUIRE)) {
+        total += current_log->cost;
+    }
+    return total;
+}
 
-        memcpy(new_exit->exit_date, exit_date, sizeof(date));
+/**
+ * Finds the billing day of a parking with a given day.
+ * @param current_parking The parking.
+ * @param day_date Any date of the day to find.
+ * @param snapshot Version of the snapshot to read.
+ * @return Pointer to the billing day, or NULL if there were no exits that day.
+ */
+billing_day *find_billing_day(parking *current_parking, timestamp day_date, version snapshot) {
+    billing_day *days;
+    int count = get_visible_days(current_parking, snapshot, &days);
+    int position = search_billing_days(days, count, day_date);
 
-        /** Allocate memory for the vehicle log. */
-        if ((new_log = (vehicle_log*)malloc(sizeof(vehicle_log)))== NULL) {
-            fprintf(stderr,"Memory allocation for new log failed\n");
-            free(new_exit->exit_date);
-            free(new_exit);
-            return;
-        }
+    if (position == count || compare_dates(days[position].exit_date, day_date) != 0) {
+        return NULL;
+    }
 
-        /** Allocate memory for exit_date. */
-        if ((new_log->exit_date = (date*)malloc(sizeof(date))) == NULL) {
-            free(new_exit->exit_date);
-            free(new_exit);
-            free(new_log);
-            return;
-        }
-        memcpy(new_log->exit_date, exit_date, sizeof(date));
-
-        /** Allocate memory for license plate and copy the value. */
-        if ((new_log->license_plate = (char *)malloc(strlen(my_vehicle->license_plate) + 1)) == NULL) {
-            free(new_exit->exit_date);
-            free(new_exit);
-            free(new_log);
-            return;
-        }
-        strcpy(new_log->license_plate, my_vehicle->license_plate);
-
-        /** Set the cost. */
-        new_log->cost = cost;
-        new_log->entry_date = NULL;
-        new_log->parking_name = NULL;
-        new_log->next = NULL;
-        new_exit->total_cost = cost;
-        new_exit->next = NULL;
-
-        /** Update pointers. */
-        current_parking->billing_day_log = new_exit;
-        current_parking->last_billing_day_log = new_exit;
-        new_exit->vehicle_log = new_log;
-        new_exit->last_vehicle_log = new_log;
+    return &days[position];
+}
 
-    } else {
+/**
+ * Calculates the revenue of a parking between two days, both included.
+ * @param current_parking The parking.
+ * @param first_date Any date of the first day.
+ * @param last_date Any date of the last day.
+ * @return The total cost of the exits between the two days, in cents.
+ */
+money get_revenue_between(parking *current_parking, timestamp first_date, timestamp last_date) {
+    int first, after_last;
+    money revenue;
+
+    /** The first day not in the range is the first one not before the next day. */
+    first = find_billing_position(current_parking, first_date);
+    after_last = find_billing_position(current_parking, last_date + MINUTES_IN_DAY);
+    if (first >= after_last) {
+        return 0;
+    }
 
-        /** Add new billing day. */
-        add_new_billing_day(current_parking, exit_date, cost, my_vehicle);
+    /** Subtract the cumulative costs before the range from the ones up to its end. */
+    revenue = current_parking->billing_days[after_last - 1].cumulative_cost;
+    if (first > 0) {
+        revenue -= current_parking->billing_days[first - 1].cumulative_cost;
     }
-        
+
+    return revenue;
 }
 
 /**
- * Frees the vehicle log
- * @param head The vehicle log to free.
+ * Prices again a group of logs with a tariff.
+ * @param prices The tariff.
+ * @param logs The logs.
+ * @param entry_dates The entry dates of the logs.
+ * @param exit_dates The exit dates of the logs.
+ * @param count Number of logs.
  */
-void free_vehicle_logs(vehicle_log *head) {
-    /** Check if the head pointer is NULL, indicating an empty list. */
-    if (head == NULL) {
-        /** If the list is empty, there's nothing to free, so return. */
-        return; 
-    }
-    /** Iterate through the list until reaching the end. */
-    while (head != NULL) {
-        vehicle_log *temp = head; 
-        head = head->next; 
-        /** Free memory of the current node. */
-        free(temp->exit_date);
-        free(temp->license_plate);
-        free(temp->parking_name);
-        free(temp->entry_date);
-        /** Free the current node. */
-        free(temp); 
+static void reprice_logs(tariff *prices, vehicle_log **logs, timestamp *entry_dates,
+    timestamp *exit_dates, int count) {
+    money costs[PRICING_BLOCK];
+    int i;
+
+    calculate_costs(prices, entry_dates, exit_dates, costs, count);
+    for (i = 0; i < count; i++) {
+        logs[i]->cost = costs[i];
     }
 }
 
 /**
- * Removes vehicle logs associated with a specific parking name from a vehicle's log list.
- * @param current_vehicle The vehicle from which logs are to be removed.
- * @param parking_name The name of the parking to remove logs for.
+ * Prices again the stays of a parking that exit between two days, both
+ * included, with the tariffs in effect at their exits, and adds up the
+ * billing days of the range again. The logs of each day are in the
+ * order of their exits, so they are priced in groups with the same
+ * tariff. No snapshot may be reading the parking.
+ * @param current_parking The parking.
+ * @param first_date Any date of the first day.
+ * @param last_date Any date of the last day.
  */
-void remove_vehicle_logs(vehicle *current_vehicle, char *parking_name){
-
-    vehicle_log *current, *first, *prev, *temp;
-    current = current_vehicle->my_logs;
-    prev = NULL;
-    first = NULL;
-    temp = NULL;
+void reprice_parking(parking *current_parking, timestamp first_date, timestamp last_date) {
+    billing_day *days = current_parking->billing_days;
+    vehicle_log *logs[PRICING_BLOCK], *current_log;
+    timestamp entry_dates[PRICING_BLOCK], exit_dates[PRICING_BLOCK];
+    tariff *prices = NULL, *log_prices;
+    money cumulative_cost, change;
+    int first, after_last, i, count = 0;
+
+    first = find_billing_position(current_parking, first_date);
+    after_last = find_billing_position(current_parking, last_date + MINUTES_IN_DAY);
+
+    for (i = first; i < after_last; i++) {
+        for (current_log = days[i].vehicle_log; current_log != NULL;
+            current_log = current_log->next_in_day) {
+            log_prices = find_tariff(current_parking, current_log->exit_date);
+            if (count == PRICING_BLOCK || (count > 0 && log_prices != prices)) {
+                reprice_logs(prices, logs, entry_dates, exit_dates, count);
+                count = 0;
+            }
+            prices = log_prices;
+            logs[count] = current_log;
+            entry_dates[count] = current_log->entry_date;
+            exit_dates[count] = current_log->exit_date;
+            count++;
+        }
+    }
+    if (count > 0) {
+        reprice_logs(prices, logs, entry_dates, exit_dates, count);
+    }
 
-    /** iterate through the vehicle log list. */
-    while (current != NULL) {
-        /** Check if the current log is from the specified parking name. 
-         * and remove the log.
-        */
-        if (strcmp(current->parking_name, parking_name) == 0) {
-            /** Free the logs of the current vehicle. */
-            free(current->parking_name); 
-            free(current->entry_date);   
-            free(current->exit_date);    
-            free(current->license_plate);
-            temp = current;  
-            current = current->next;     
-            free(temp);                   
+    /** The costs are exact, so the days after the range only move by
+     * the change of its revenue. */
+    if (first < after_last) {
+        cumulative_cost = first > 0 ? days[first - 1].cumulative_cost : 0;
+        change = -days[after_last - 1].cumulative_cost;
+        for (i = first; i < after_last; i++) {
+            days[i].total_cost = 0;
+            for (current_log = days[i].vehicle_log; current_log != NULL;
+                current_log = current_log->next_in_day) {
+                days[i].total_cost += current_log->cost;
+            }
+            cumulative_cost += days[i].total_cost;
+            days[i].cumulative_cost = cumulative_cost;
+        }
+        change += cumulative_cost;
+        for (i = after_last; i < current_parking->num_billing_days; i++) {
+            days[i].cumulative_cost += change;
         }
-        else {
-            /** If the log is not associated with the parking name.
-             * update the pointers;
-             */
-            if(first == NULL)
-                /** Store the first for later update of the vehicle logs list. */
-                first = current;         
-            
-            /** Link the previous log to the next valid log. */
-            if (prev != NULL)
-                prev->next = current;
+    }
+}
 
-            /** Update the previous log. */
-            prev = current;
+/**
+ * Adds a new exit revenue record for a vehicle in a parking.
+ * @param current_parking The parking where the vehicle was parked.
+ * @param exit_log The log of the vehicle, with its exit date and cost.
+ */
+void add_new_exit(parking *current_parking, vehicle_log *exit_log){
 
-            /** Move to the next log. */            
-            current = current->next;     
-        }   
+    /** Check if any of the parameters is missing. */
+    if (current_parking == NULL || exit_log == NULL || exit_log->exit_date == NO_DATE) {
+        return;
     }
-    /** If there's a previous log, set its next pointer to NULL. */
-    if (prev != NULL)
-        prev->next = NULL;
 
-    /** Update the vehicle's log pointers and state. */
-    current_vehicle->my_last_log = prev;  
-    current_vehicle->my_logs = first;   
-    current_vehicle->is_parked = 0;       
+    /** Add the exit to the last billing day, or to a new one. */
+    add_new_billing_day(current_parking, exit_log);
 }
 
 /**
- * Removes vehicle logs associated with a specific parking name.
- * @param vehicles The hashtable of vehicles.
- * @param parking_name The name of the parking to remove logs for.
+ * Removes the history of a vehicle in a parking from the vehicle's histories.
+ * @param history The history to remove.
  */
-void remove_parking_from_logs(hashtable *vehicles, char *parking_name) {
-    int i;
-    entry *current_entry;
-    vehicle *current_vehicle;
-    /** Iterate through each slot in the hashtable. */
-    for (i = 0; i < vehicles->length; i++) {
-        current_entry = &(vehicles->entries[i]); 
-        /** iterate the linked list of entries in the current slot */
-        while (current_entry != NULL) {
-            /** Get the vehicle associated with the current entry. */
-            current_vehicle = current_entry->value; 
-            if (current_vehicle != NULL) {
-                /** Remove all logs from that vehicle associated with the parking. */
-                remove_vehicle_logs(current_vehicle, parking_name);
-            }
-            current_entry = current_entry->next; 
-        }
+void remove_vehicle_history(parking_history *history){
+
+    vehicle *current_vehicle = history->my_vehicle;
+
+    /** Unlink it, the history and its logs are freed with the parking pools. 
+     * Its next history is kept, for the snapshots reading it. */
+    if (history->prev == NULL) {
+        __atomic_store_n(&current_vehicle->histories, history->next, __ATOMIC_RELEASE);
+    } else {
+        __atomic_store_n(&history->prev->next, history->next, __ATOMIC_RELEASE);
+    }
+    if (history->next != NULL) {
+        history->next->prev = history->prev;
     }
-}
 
+    if (current_vehicle->last_history == history) {
+        current_vehicle->last_history = NULL;
+    }
 
+    /** A vehicle still inside the parking leaves with it. */
+    if (current_vehicle->is_parked && 
+        current_vehicle->parking_id == history->my_parking->id) {
+        current_vehicle->is_parked = 0;
+        current_vehicle->parking_id = NO_PARKING;
+    }
+}
 
 /**
- * Frees memory allocated for a parking structure.
+ * Frees memory allocated for a parking structure, with all its 
+ * billing days and the vehicle logs and histories of its pools.
  * @param park The parking structure to free.
  */
 void free_parking(parking *park) {
-    free(park->name); 
-    remove_billing_days(park->billing_day_log); 
-    free(park);
+    replaced_days *replaced;
+    tariff *current_tariff;
+
+    tracked_free(park->name, strlen(park->name) + 1, ALLOC_STRING);
+    tracked_free(park->billing_days, sizeof(billing_day) * park->billing_capacity,
+        ALLOC_BILLING_DAY);
+    while ((replaced = park->replaced) != NULL) {
+        park->replaced = replaced->next;
+        tracked_free(replaced->billing_days, sizeof(billing_day) * replaced->billing_capacity,
+            ALLOC_BILLING_DAY);
+        tracked_free(replaced, sizeof(replaced_days), ALLOC_BILLING_DAY);
+    }
+    while ((current_tariff = park->tariffs) != NULL) {
+        park->tariffs = current_tariff->next;
+        tracked_free(current_tariff, sizeof(tariff), ALLOC_PARKING);
+    }
+    free_pool(&park->log_pool);
+    free_pool(&park->history_pool);
+    tracked_free(park, sizeof(parking), ALLOC_PARKING);
 }
 
+
 /**
- * Removes billing days associated with a parking.
- * @param head The head of the billing day linked list to remove.
+ * Removes a parking from the registry, so it can no longer be found, 
+ * and queues it to reclaim its memory.
+ * @param parking_args The argument containing the list of parkings.
+ * @param parking_name The name of the parking to remove.
  */
-void remove_billing_days(billing_day *head) {
-    /** iterate the linked list of billing days. */
-    while (head != NULL) {
-        billing_day *temp = head; 
-        head = head->next; 
-        /** free all the vehicle logs of the billing day. */
-        free_vehicle_logs(temp->vehicle_log);
-
-        /** Set the pointers to NULL. */
-        temp->vehicle_log = NULL; 
-        temp->last_vehicle_log = NULL; 
-        free(temp->exit_date);
-        temp->exit_date = NULL; 
+void remove_parking_from_list(args *parking_args, char *parking_name) {
+    parking_registry *registry = &parking_args->registry;
+    parking *my_parking;
+    int *slot, position;
 
-        /** Free the current node. */
-        free(temp); 
+    /** Find the slot of the parking in the name index. */
+    if ((slot = find_name_slot(registry, parking_name)) == NULL) {
+        return;
+    }
+    my_parking = registry->parkings[*slot];
+
+    /** Mark the slot as removed and clear the id, which is never given again. */
+    *slot = REMOVED_SLOT;
+    registry->parkings[my_parking->id] = NULL;
+
+    /** Remove it from the sorted array. */
+    position = find_sorted_position(registry, parking_name);
+    memmove(&registry->sorted[position], &registry->sorted[position + 1],
+        sizeof(parking *) * (registry->num_parkings - position - 1));
+    registry->num_parkings--;
+
+    /** Hide it and queue it to be reclaimed, a few histories at a time. */
+    __atomic_store_n(&my_parking->removed_version, parking_args->command_version,
+        __ATOMIC_RELEASE);
+    my_parking->next_removed = NULL;
+    if (registry->removed == NULL) {
+        registry->removed = my_parking;
+    } else {
+        registry->last_removed->next_removed = my_parking;
     }
+    registry->last_removed = my_parking;
 }
 
-
 /**
- * Removes a parking from a array of parkings and everything related.
+ * Reclaims the vehicle histories of removed parkings, freeing each 
+ * parking once all the histories that reference it are unlinked.
+ * Snapshots older than the removal still show the parking, so it is
+ * only unlinked after them, and freed after the snapshots that may
+ * have started before it was unlinked.
  * @param parking_args The argument containing the list of parkings.
- * @param parking_name The name of the parking to remove.
+ * @param max_steps Max number of histories to unlink.
  */
-void remove_parking_from_list(args *parking_args, char *parking_name) {
-    int i;
-    for (i = 0; i < parking_args->park_counter; i++) {
-        /** Iterate through the array lokking for the parking. */
-        if (parking_args->parkings[i] != NULL && 
-            strcmp(parking_args->parkings[i]->name, parking_name) == 0) {
-    
-            /** Remove the billing days of the parking. */
-            remove_billing_days(parking_args->parkings[i]->billing_day_log);
-
-            /** Set the pointer to NULL and free the parking. */
-            parking_args->parkings[i]->billing_day_log = NULL;
-            free_parking(parking_args->parkings[i]);
-
-            /** Shift the elements to fill the gap. */
-            for (int j = i; j < MAX_PARKINGS - 1; j++) {
-                parking_args->parkings[j] = parking_args->parkings[j + 1];
+void reclaim_removed_parkings(args *parking_args, int max_steps) {
+    parking_registry *registry = &parking_args->registry;
+    parking *my_parking;
+    parking_history *current_history;
+    version oldest_report = parking_args->engine != NULL ?
+        get_oldest_report(parking_args->engine) : NO_VERSION;
+    int steps = 0;
+
+    while (steps < max_steps && (my_parking = registry->removed) != NULL &&
+        oldest_report > my_parking->removed_version) {
+        /** Free the parking when no vehicle references it. */
+        if (my_parking->histories == NULL) {
+            if (my_parking->unlinked_version == NO_VERSION) {
+                my_parking->unlinked_version = parking_args->command_version;
             }
-
-            /** Set the last element to NULL. */
-            parking_args->parkings[MAX_PARKINGS - 1] = NULL;
-            parking_args->park_counter--;
-            break;
+            if (oldest_report <= my_parking->unlinked_version) {
+                break;
+            }
+            registry->removed = my_parking->next_removed;
+            free_parking(my_parking);
+            continue;
         }
+
+        current_history = my_parking->histories;
+        my_parking->histories = current_history->next_in_parking;
+        remove_vehicle_history(current_history);
+        steps++;
     }
 }
 
@@ -916,10 +1679,21 @@ void free_parking_args(args* parking_args) {
         return; 
     }
 
-    /** Free each parking in the parkings array. */
-    for ( i = 0; i < parking_args->park_counter; ++i) {
-        free_parking(parking_args->parkings[i]);
+    /** Free each parking that exists and the registry arrays. */
+    for (i = 0; i < parking_args->registry.num_parkings; ++i) {
+        free_parking(parking_args->registry.sorted[i]);
+    }
+    while (parking_args->registry.removed != NULL) {
+        parking *removed = parking_args->registry.removed;
+        parking_args->registry.removed = removed->next_removed;
+        free_parking(removed);
     }
+    tracked_free(parking_args->registry.parkings,
+        sizeof(parking *) * parking_args->registry.capacity, ALLOC_REGISTRY);
+    tracked_free(parking_args->registry.sorted,
+        sizeof(parking *) * parking_args->registry.capacity, ALLOC_REGISTRY);
+    tracked_free(parking_args->registry.name_index,
+        sizeof(int) * parking_args->registry.index_length, ALLOC_REGISTRY);
 
     /** Free the vehicles hashtable if it's not NULL. */
     if (parking_args->vehicles != NULL) {
@@ -927,61 +1701,37 @@ void free_parking_args(args* parking_args) {
     }
 
     /** Finally, free the parking_args structure itself. */
-    free(parking_args);
+    tracked_free(parking_args, sizeof(args), ALLOC_OTHER);
     parking_args = NULL;
 }
 
 
-/**
- * Frees memory allocated for a vehicle structure.
- * @param my_vehicle The vehicle structure to free.
- */
-void free_vehicle(vehicle *my_vehicle){
-
-    free(my_vehicle->license_plate);
-    free(my_vehicle->parking_name);
-    free_vehicle_logs(my_vehicle->my_logs);
-    free(my_vehicle);
-}
-
-
 /**
  * Frees memory allocated for a hashtable structure.
  * @param ht The hashtable structure to free.
  */
 void free_hashtable(hashtable *ht) {
-
-    int i;
-    entry *current_entry, *next_entry;
+    entry_table *table;
 
     if (ht == NULL) {
         return; 
     }
 
-    /** Free each entry in the hashtable. */
-    for (i = 0; i < ht->length; ++i) {
-        if(ht->entries[i].key != NULL){
-            free_vehicle(ht->entries[i].value);
-            free(ht->entries[i].key);
-            current_entry = ht->entries[i].next; 
-            while (current_entry != NULL) {
-                /** Store the next entry before freeing the current one. */
-                next_entry = current_entry->next; 
-                free_vehicle(current_entry->value);
-                /** Free the key string. */
-                free(current_entry->key); 
-                /** Free the entry itself. */
-                free(current_entry); 
-                /**Move to the next entry. */
-                current_entry = next_entry; 
-            }
+    /** Free all the vehicles at once and the tables of entries. */
+    free_pool(&ht->vehicle_pool);
+    if (ht->table != NULL) {
+        if (ht->table->old != NULL) {
+            free_entry_table(ht->table->old);
         }
+        free_entry_table(ht->table);
     }
-
-    /** Free the entries array. */
-    free(ht->entries);
+    while ((table = ht->retired) != NULL) {
+        ht->retired = table->next_retired;
+        free_entry_table(table);
+    }
+    pthread_rwlock_destroy(&ht->grow_lock);
 
     /** Finally, free the hashtable structure itself. */
-    free(ht);
+    tracked_free(ht, sizeof(hashtable), ALLOC_OTHER);
 }
 
@@ -7,59 +7,91 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 
 #include "proj1.h"
 
 /** Initialize funcitons. ***********************/
 void initialize_parking_list(args *parking_args);
 void initialize_hashtable(args *parking_args);
+void initialize_calendar(void);
 
 
 /** Parser functions. */
-char *parse_name(char *buffer);
-date *parse_date(char *date_input, char *time_input);
+int parse_date(char *date_input, char *time_input, date *parsed_date);
+money parse_money(char *input);
 
 
 /** Hastable related functions. */
-size_t hash_function(char *key);
-void insert_new_entry(hashtable *ht,char *key, vehicle *value);
-vehicle *find_vehicle(hashtable *vehicles, char *license_plate);
+size_t hash_function(plate key);
+vehicle *insert_new_entry(hashtable *ht, plate key, vehicle *value);
+void share_hashtable(hashtable *ht);
+vehicle *find_vehicle(hashtable *vehicles, plate license_plate);
 
 
 /** Fucntions to validation and error checking. */
 int is_license_plate_valid(char *license_plate);
+plate pack_license_plate(char *license_plate);
+void output_license_plate(plate license_plate);
+int is_calendar_date(date *my_date);
 int is_date_valid( date *entry_date, args *parking_args);
-int compare_dates(date *date_1, date *date_2);
+int compare_dates(timestamp date_1, timestamp date_2);
 
 
 /** Funtions to add the nodes to the linked lists. */
-void add_new_billing_day(parking *current_parking, date *exit_date, double cost, vehicle *my_vehicle);
-void add_new_exit(parking *current_parking, date *exit_date, double cost, vehicle *my_vehicle);
-void add_new_log(vehicle *my_vehicle, parking *current_parking, date *entry_date, char *name);
-
-
-/** Sorting algorithm. */
-void insertion_sort(char **array, int num_elements);
+void add_new_billing_day(parking *current_parking, vehicle_log *exit_log);
+void add_new_exit(parking *current_parking, vehicle_log *exit_log);
+int find_billing_position(parking *current_parking, timestamp day_date);
+billing_day *find_billing_day(parking *current_parking, timestamp day_date, version snapshot);
+money get_revenue_between(parking *current_parking, timestamp first_date, timestamp last_date);
+void reprice_parking(parking *current_parking, timestamp first_date, timestamp last_date);
+parking_history *find_parking_history(vehicle *my_vehicle, parking *current_parking);
+vehicle *add_new_vehicle(hashtable *vehicles, plate license_plate);
+vehicle_log *append_vehicle_log(parking_history *history, timestamp entry_date,
+    version entry_version);
+void add_new_log(parking_history *history, timestamp entry_date, int free_spaces,
+    version entry_version);
+
+
+/** Snapshot functions. */
+int is_parking_removed(parking *my_parking, version snapshot);
+int is_exit_visible(vehicle_log *current_log, version snapshot);
+vehicle_log *get_visible_log(vehicle_log **link, version snapshot);
+int get_visible_days(parking *current_parking, version snapshot, billing_day **days);
+money get_day_total(billing_day *day, int is_last, version snapshot);
+
+
+/** Timestamp output functions. */
+void output_day(timestamp time);
+void output_hour(timestamp time);
+void output_timestamp(timestamp time);
+
+
+/** Parking registry functions. */
+size_t hash_name(char *name);
+parking *find_parking(args *parking_args,char *name);
+int add_parking_to_list(args *parking_args, parking *new_parking);
 
 
 /** Auxiliar functions. */
-parking *find_parking(args *parking_args,char *name);
 int get_days_in_month(int month);
 int is_vehicle_parked(vehicle *my_vehicle);
-int get_all_minutes(date *entry_date, date * exit_date);
-double calculate_cost(parking *current_parking, vehicle_log *current_log);
+long long get_all_minutes(date *my_date);
+void get_date_fields(timestamp time, date *my_date);
+tariff *create_tariff(timestamp effective_date, money X, money Y, money Z);
+void insert_tariff(parking *current_parking, tariff *new_tariff);
+tariff *find_tariff(parking *current_parking, timestamp exit_date);
+money calculate_cost(parking *current_parking, vehicle_log *current_log);
+void calculate_costs(tariff *prices, const timestamp *entry_dates,
+    const timestamp *exit_dates, money *costs, int count);
 
 
 /** Functions for removal. */
-void remove_parking_from_logs(hashtable *vehicles, char *parking_name);
-void remove_billing_days(billing_day *head);
+void remove_vehicle_history(parking_history *history);
 void remove_parking_from_list(args *parking_args, char *parking_name);
+void reclaim_removed_parkings(args *parking_args, int max_steps);
 
 
 /** Free functions. */
 void free_parking(parking *park);
-void free_vehicle_logs(vehicle_log *head);
 void free_parking_args(args* parking_args);
-void free_vehicle(vehicle *my_vehicle);
 void free_hashtable(hashtable *ht);
@@ -0,0 +1,64 @@
+/**
+ * Benchmark harness that runs a workload through the command interpreter
+ * and reports the throughput and the statistics of each command type
+ * (the same as -s).
+ * The output of the commands goes to stdout and the report to stderr.
+ *
+ * Build: gcc -O2 -o bench/harness bench/harness.c aux.c proj1.c input.c output.c pool.c stats.c shard.c checkpoint.c wal.c -lpthread -lm
+ * Usage: bench/harness workload.txt > /dev/null
+ * @file harness.c
+ * @author ist1106369 Sophia Alencar
+*/
+
+#include "../aux.h"
+
+/**
+ * Runs the workload and prints the report.
+ * @param argc Number of arguments.
+ * @param argv Arguments, the path of the workload.
+ * @return Returns 0 upon successful completion.
+ */
+int main(int argc, char *argv[]) {
+    FILE *stream;
+    input_reader reader;
+    command_line line;
+    args *parking_args;
+    uint64_t start, total = 0, commands = 0;
+
+    if (argc != 2 || (stream = fopen(argv[1], "rb")) == NULL) {
+        fprintf(stderr, "usage: %s workload.txt > /dev/null\n", argv[0]);
+        return 1;
+    }
+
+    if (initialize_reader(&reader, stream) != 0 ||
+        (parking_args = (args *)malloc(sizeof(args))) == NULL) {
+        return 1;
+    }
+    initialize_parking_list(parking_args);
+    initialize_hashtable(parking_args);
+    initialize_calendar();
+
+    /** The latencies of each command type are recorded by the statistics. */
+    enable_stats();
+
+    /** Time each command, reading it is not included. */
+    while (read_command(&reader, &line) && line.command != 'q') {
+        start = stats_clock();
+        execute_command(parking_args, &line);
+        start = stats_clock() - start;
+
+        total += start;
+        commands++;
+    }
+    flush_output();
+
+    /** Report the throughput and the latencies of each command type. */
+    fprintf(stderr, "commands %llu time %.3f s throughput %.0f commands/s\n",
+        (unsigned long long)commands, total / 1e9, total > 0 ? commands / (total / 1e9) : 0.0);
+    print_stats(stderr);
+
+    free_parking_args(parking_args);
+    free_reader(&reader);
+    fclose(stream);
+    return 0;
+}
@@ -0,0 +1,287 @@
+/**
+ * Micro-benchmarks of the core kernels of the parking system,
+ * at several data sizes. The results are written to stdout as JSON.
+ *
+ * Build: gcc -O2 -o bench/micro bench/micro.c aux.c proj1.c input.c output.c pool.c stats.c shard.c checkpoint.c wal.c -lpthread -lm
+ * Usage: bench/micro [max size] > results.json
+ * @file micro.c
+ * @author ist1106369 Sophia Alencar
+*/
+
+#include <time.h>
+
+#include "../aux.h"
+
+/** Default largest data size. */
+#define DEFAULT_MAX_SIZE (1 << 20)
+
+/** Smallest data size, each size is 16 times the previous. */
+#define MIN_SIZE (1 << 10)
+
+/** Largest number of parkings, the sorted insertion is quadratic. */
+#define MAX_PARKINGS_SIZE (1 << 14)
+
+/** Read only kernels are repeated until they run for this long. */
+#define MIN_KERNEL_TIME 20000000L
+
+/** Structs. */
+
+typedef struct {
+    plate *keys;            /**< Packed license plates. */
+    char (*plates)[LICENSE_PLATE_SIZE]; /**< License plates, half of them not valid. */
+    char (*dates)[11];      /**< Dates (dd-mm-yyyy). */
+    char (*times)[6];       /**< Times (hh:mm). */
+    timestamp *timestamps;  /**< Random timestamps. */
+    vehicle_log *logs;      /**< Logs with increasing exit dates. */
+    timestamp *entry_dates; /**< Entry dates of the logs. */
+    timestamp *exit_dates;  /**< Exit dates of the logs. */
+    money *costs;           /**< Costs of the logs, priced together. */
+    vehicle *vehicles;      /**< Vehicles of the hashtable. */
+    int size;               /**< Number of items of each array. */
+} kernel_data;
+
+/** Sink of the results, so the kernels are not optimized away. */
+static volatile size_t sink;
+
+/** State of the random generator. */
+static uint64_t random_state = 0x9E3779B97F4A7C15ULL;
+
+/** Whether a result was already written, to separate them with commas. */
+static int first_result = 1;
+
+/**
+ * Gets the next random number (xorshift64*).
+ * @return A random 64 bit number.
+ */
+static uint64_t next_random(void) {
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    return random_state * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * Gets the current time of a monotonic clock.
+ * @return The time in nanoseconds.
+ */
+static long now(void) {
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000L + time.tv_nsec;
+}
+
+/**
+ * Writes the result of a kernel as a JSON object.
+ * @param kernel Name of the kernel.
+ * @param size Data size.
+ * @param operations Number of operations timed.
+ * @param elapsed Time of all the operations, in nanoseconds.
+ */
+static void report(const char *kernel, int size, long operations, long elapsed) {
+    printf("%s\n  {\"kernel\": \"%s\", \"size\": %d, \"operations\": %ld, "
+        "\"ns_per_op\": %.2f}", first_result ? "" : ",", kernel, size, operations,
+        (double)elapsed / operations);
+    first_result = 0;
+}
+
+/**
+ * Fills the data of the kernels with random values.
+ * @param data Pointer to the data.
+ * @param size Number of items of each array.
+ * @return 0 on success, -1 if the memory could not be allocated.
+ */
+static int initialize_data(kernel_data *data, int size) {
+    static const char letters[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    int i, j;
+    timestamp exit_date = (2024 * DAYS_IN_YEAR + 1) * MINUTES_IN_DAY;
+
+    data->size = size;
+    data->keys = (plate *)malloc(sizeof(plate) * size);
+    data->plates = malloc(sizeof(*data->plates) * size);
+    data->dates = malloc(sizeof(*data->dates) * size);
+    data->times = malloc(sizeof(*data->times) * size);
+    data->timestamps = (timestamp *)malloc(sizeof(timestamp) * size);
+    data->logs = (vehicle_log *)malloc(sizeof(vehicle_log) * size);
+    data->entry_dates = (timestamp *)malloc(sizeof(timestamp) * size);
+    data->exit_dates = (timestamp *)malloc(sizeof(timestamp) * size);
+    data->costs = (money *)malloc(sizeof(money) * size);
+    data->vehicles = (vehicle *)malloc(sizeof(vehicle) * size);
+    if (data->keys == NULL || data->plates == NULL || data->dates == NULL ||
+        data->times == NULL || data->timestamps == NULL || data->logs == NULL ||
+        data->entry_dates == NULL || data->exit_dates == NULL || data->costs == NULL ||
+        data->vehicles == NULL) {
+        return -1;
+    }
+
+    for (i = 0; i < size; i++) {
+        /** Unique valid plates (AA-00-AA), every other one is spoiled after packing. */
+        snprintf(data->plates[i], LICENSE_PLATE_SIZE, "%c%c-%02d-%c%c",
+            letters[i % 26], letters[i / 26 % 26], i / 676 % 100,
+            letters[i / 67600 % 26], letters[i / 1757600 % 26]);
+        data->keys[i] = pack_license_plate(data->plates[i]);
+        if (i % 2 == 1) {
+            j = next_random() % 8;
+            data->plates[i][j] = data->plates[i][j] == '-' ? 'A' : 'a';
+        }
+
+        snprintf(data->dates[i], sizeof(data->dates[i]), "%02d-%02d-%04d",
+            (int)(next_random() % 28 + 1), (int)(next_random() % 12 + 1),
+            (int)(next_random() % 50 + 2000));
+        snprintf(data->times[i], sizeof(data->times[i]), "%02d:%02d",
+            (int)(next_random() % 24), (int)(next_random() % 60));
+        data->timestamps[i] = (timestamp)(exit_date + next_random() % (100 * MINUTES_IN_DAY));
+
+        /** About four exits a day, each after a stay of up to three days. */
+        exit_date += next_random() % 720;
+        data->logs[i].license_plate = data->keys[i];
+        data->logs[i].exit_date = exit_date;
+        data->logs[i].entry_date = exit_date - next_random() % (3 * MINUTES_IN_DAY);
+        data->logs[i].cost = 100;
+        data->entry_dates[i] = data->logs[i].entry_date;
+        data->exit_dates[i] = data->logs[i].exit_date;
+    }
+    return 0;
+}
+
+/**
+ * Frees the data of the kernels.
+ * @param data Pointer to the data.
+ */
+static void free_data(kernel_data *data) {
+    free(data->keys);
+    free(data->plates);
+    free(data->dates);
+    free(data->times);
+    free(data->timestamps);
+    free(data->logs);
+    free(data->entry_dates);
+    free(data->exit_dates);
+    free(data->costs);
+    free(data->vehicles);
+}
+
+/**
+ * Benchmarks the read only kernels, each over all the items of the data.
+ * @param data Pointer to the data.
+ * @param parking_args Pointer to the args with the vehicles of the data.
+ * @param tariff Pointer to a parking with the costs.
+ */
+static void run_read_kernels(kernel_data *data, args *parking_args, parking *tariff) {
+    static const char *kernels[] = { "hash_function", "find_vehicle",
+        "is_license_plate_valid", "parse_date", "calculate_cost", "compare_dates" };
+    long start, elapsed, operations;
+    size_t result = 0;
+    int kernel, i;
+    date parsed_date;
+
+    for (kernel = 0; kernel < (int)(sizeof(kernels) / sizeof(kernels[0])); kernel++) {
+        operations = 0;
+        start = now();
+        do {
+            for (i = 0; i < data->size; i++) {
+                switch (kernel) {
+                    case 0: result += hash_function(data->keys[i]); break;
+                    case 1: result += (size_t)find_vehicle(parking_args->vehicles,
+                        data->keys[(i * 7919L) % data->size]); break;
+                    case 2: result += is_license_plate_valid(data->plates[i]); break;
+                    case 3: result += parse_date(data->dates[i], data->times[i], &parsed_date) +
+                        parsed_date.year; break;
+                    case 4: result += (size_t)calculate_cost(tariff, &data->logs[i]); break;
+                    default: result += compare_dates(data->timestamps[i],
+                        data->timestamps[data->size - 1 - i]) + 1; break;
+                }
+            }
+            operations += data->size;
+            elapsed = now() - start;
+        } while (elapsed < MIN_KERNEL_TIME);
+        report(kernels[kernel], data->size, operations, elapsed);
+    }
+
+    /** The same stays as calculate_cost, priced together. */
+    operations = 0;
+    start = now();
+    do {
+        calculate_costs(tariff->tariffs, data->entry_dates, data->exit_dates, data->costs, data->size);
+        result += (size_t)data->costs[operations % data->size];
+        operations += data->size;
+        elapsed = now() - start;
+    } while (elapsed < MIN_KERNEL_TIME);
+    report("calculate_costs", data->size, operations, elapsed);
+    sink = result;
+}
+
+/**
+ * Benchmarks the kernels that build structures, once per size.
+ * @param data Pointer to the data.
+ */
+static void run_kernels(kernel_data *data) {
+    args *parking_args;
+    parking *tariff;
+    long start;
+    int i;
+    char name[32];
+
+    if ((parking_args = (args *)malloc(sizeof(args))) == NULL) {
+        return;
+    }
+    initialize_parking_list(parking_args);
+    initialize_hashtable(parking_args);
+
+    /** Insertions in the vehicles hashtable, growing from the initial length. */
+    start = now();
+    for (i = 0; i < data->size; i++) {
+        insert_new_entry(parking_args->vehicles, data->keys[i], &data->vehicles[i]);
+    }
+    report("insert_new_entry", data->size, data->size, now() - start);
+
+    /** Exits appended to the billing days of a parking. */
+    add_new_parking(parking_args, "tariff", 1, 25, 30, 1500);
+    tariff = find_parking(parking_args, "tariff");
+    start = now();
+    for (i = 0; i < data->size; i++) {
+        add_new_exit(tariff, &data->logs[i]);
+    }
+    report("add_new_exit", data->size, data->size, now() - start);
+
+    run_read_kernels(data, parking_args, tariff);
+
+    /** Parkings added to the registry in random name order (the sorted
+     * insertion replaced insertion_sort). */
+    if (data->size <= MAX_PARKINGS_SIZE) {
+        start = now();
+        for (i = 0; i < data->size; i++) {
+            snprintf(name, sizeof(name), "P%016llx", (unsigned long long)next_random());
+            add_new_parking(parking_args, name, 1, 25, 30, 1500);
+        }
+        report("add_new_parking", data->size, data->size, now() - start);
+    }
+
+    /** The vehicles are in the data, not in the hashtable pool. */
+    free_parking_args(parking_args);
+}
+
+/**
+ * Runs the micro-benchmarks at each size.
+ * @param argc Number of arguments.
+ * @param argv Arguments, optionally the largest data size.
+ * @return Returns 0 upon successful completion.
+ */
+int main(int argc, char *argv[]) {
+    kernel_data data;
+    int size, max_size = argc > 1 ? atoi(argv[1]) : DEFAULT_MAX_SIZE;
+
+    initialize_calendar();
+
+    printf("[");
+    for (size = MIN_SIZE; size <= max_size; size *= 16) {
+        if (initialize_data(&data, size) != 0) {
+            fprintf(stderr, "Memory allocation of benchmark data failed\n");
+            return 1;
+        }
+        run_kernels(&data);
+        free_data(&data);
+    }
+    printf("\n]\n");
+    return 0;
+}
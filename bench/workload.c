@@ -0,0 +1,327 @@
+/**
+ * Deterministic generator of synthetic workloads for the parking system.
+ * Writes the commands to stdout, ending with 'q'.
+ *
+ * Build: gcc -O2 -o bench/workload bench/workload.c -lm
+ * Usage: bench/workload [-s seed] [-n commands] [-p parkings] [-k plates]
+ *        [-d days] [-x exit share] [-v v rate] [-f f rate] [-r r rate] [-z skew]
+ * @file workload.c
+ * @author ist1106369 Sophia Alencar
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+
+/** Default values of the options. */
+#define DEFAULT_SEED 1
+#define DEFAULT_COMMANDS 1000000
+#define DEFAULT_PARKINGS 20
+#define DEFAULT_PLATES 100000
+#define DEFAULT_DAYS 365
+#define DEFAULT_EXIT_SHARE 0.5
+#define DEFAULT_V_RATE 0.02
+#define DEFAULT_F_RATE 0.01
+#define DEFAULT_R_RATE 0.0001
+#define DEFAULT_SKEW 1.0
+
+/** First year of the generated dates. */
+#define FIRST_YEAR 2024
+
+/** Number of days in a year and minutes in a day. */
+#define DAYS_IN_YEAR 365
+#define MINUTES_IN_DAY (24 * 60)
+
+/** Structs. */
+
+typedef struct {
+    uint64_t seed;          /**< Seed of the random generator. */
+    long commands;          /**< Number of commands after the parkings. */
+    int parkings;           /**< Number of parkings. */
+    int plates;             /**< Number of different plates. */
+    int days;               /**< Number of days the commands span. */
+    double exit_share;      /**< Share of entries and exits that are exits. */
+    double v_rate;          /**< Share of v commands. */
+    double f_rate;          /**< Share of f commands. */
+    double r_rate;          /**< Share of r commands (each parking is added back). */
+    double skew;            /**< Exponent of the zipf popularity of the plates. */
+} workload_options;
+
+typedef struct {
+    uint64_t state;         /**< State of the random generator. */
+    double *popularity;     /**< Cumulative popularity of each plate. */
+    int *parked_in;         /**< Parking of each plate, -1 if not parked. */
+    int *parked;            /**< Plates parked, in no order. */
+    int *parked_position;   /**< Position of each parked plate in parked. */
+    int num_parked;         /**< Number of plates parked. */
+    long minute;            /**< Minute of the last command. */
+} workload_state;
+
+/** Days of each month. */
+static const int days_in_month[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+/**
+ * Gets the next random number (xorshift64*).
+ * @param state Pointer to the workload state.
+ * @return A random 64 bit number.
+ */
+static uint64_t next_random(workload_state *state) {
+    state->state ^= state->state >> 12;
+    state->state ^= state->state << 25;
+    state->state ^= state->state >> 27;
+    return state->state * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * Gets a random number in [0, 1).
+ * @param state Pointer to the workload state.
+ * @return The random number.
+ */
+static double next_double(workload_state *state) {
+    return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * Gets a random plate following the zipf popularity.
+ * @param state Pointer to the workload state.
+ * @param options Pointer to the workload options.
+ * @return Index of the plate.
+ */
+static int next_plate(workload_state *state, workload_options *options) {
+    double target = next_double(state) * state->popularity[options->plates - 1];
+    int low = 0, high = options->plates - 1, middle;
+
+    while (low < high) {
+        middle = low + (high - low) / 2;
+        if (state->popularity[middle] <= target) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * Prints the license plate of a plate index (AA-00-AA).
+ * @param plate Index of the plate.
+ */
+static void print_plate(int plate) {
+    printf("%c%c-%02d-%c%c", 'A' + plate % 26, 'A' + plate / 26 % 26,
+        plate / 676 % 100, 'A' + plate / 67600 % 26, 'A' + plate / 1757600 % 26);
+}
+
+/**
+ * Prints the date of a minute (dd-mm-yyyy), and its time (hh:mm) if asked.
+ * @param minute Minutes since the first day.
+ * @param with_time Flag to also print the time.
+ */
+static void print_date(long minute, int with_time) {
+    long day = minute / MINUTES_IN_DAY;
+    int day_of_year = day % DAYS_IN_YEAR, month = 0;
+
+    while (day_of_year >= days_in_month[month]) {
+        day_of_year -= days_in_month[month];
+        month++;
+    }
+    printf("%02d-%02d-%04ld", day_of_year + 1, month + 1, FIRST_YEAR + day / DAYS_IN_YEAR);
+    if (with_time) {
+        printf(" %02ld:%02ld", minute % MINUTES_IN_DAY / 60, minute % 60);
+    }
+}
+
+/**
+ * Marks a plate as parked, or as not parked if parking is -1.
+ * @param state Pointer to the workload state.
+ * @param plate Index of the plate.
+ * @param parking Index of the parking.
+ */
+static void set_parked(workload_state *state, int plate, int parking) {
+    int position;
+
+    if (parking >= 0) {
+        state->parked_position[plate] = state->num_parked;
+        state->parked[state->num_parked++] = plate;
+    } else {
+        /** Move the last parked plate to its position. */
+        position = state->parked_position[plate];
+        state->parked[position] = state->parked[--state->num_parked];
+        state->parked_position[state->parked[position]] = position;
+    }
+    state->parked_in[plate] = parking;
+}
+
+/**
+ * Prints an entry, or the exit of the plate if it is already parked.
+ * @param state Pointer to the workload state.
+ * @param options Pointer to the workload options.
+ * @param plate Index of the plate.
+ * @param is_exit Flag to print the exit of a parked plate.
+ */
+static void print_movement(workload_state *state, workload_options *options, int plate, int is_exit) {
+    int parking;
+
+    if (is_exit) {
+        printf("s lot%d ", state->parked_in[plate]);
+        set_parked(state, plate, -1);
+    } else {
+        parking = next_random(state) % options->parkings;
+        printf("e lot%d ", parking);
+        set_parked(state, plate, parking);
+    }
+    print_plate(plate);
+    putchar(' ');
+    print_date(state->minute, 1);
+    putchar('\n');
+}
+
+/**
+ * Prints the removal of a parking and adds it back empty.
+ * @param state Pointer to the workload state.
+ * @param options Pointer to the workload options.
+ */
+static void print_removal(workload_state *state, workload_options *options) {
+    int parking = next_random(state) % options->parkings, i;
+
+    printf("r lot%d\n", parking);
+    printf("p lot%d %d 0.25 0.30 15.00\n", parking, options->plates);
+
+    /** The vehicles parked there are no longer parked. */
+    for (i = state->num_parked - 1; i >= 0; i--) {
+        if (state->parked_in[state->parked[i]] == parking) {
+            set_parked(state, state->parked[i], -1);
+        }
+    }
+}
+
+/**
+ * Parses the options of the command line.
+ * @param argc Number of arguments.
+ * @param argv Arguments.
+ * @param options Pointer to the options to fill.
+ * @return 0 on success, -1 if an option is not valid.
+ */
+static int parse_options(int argc, char *argv[], workload_options *options) {
+    int option;
+
+    options->seed = DEFAULT_SEED;
+    options->commands = DEFAULT_COMMANDS;
+    options->parkings = DEFAULT_PARKINGS;
+    options->plates = DEFAULT_PLATES;
+    options->days = DEFAULT_DAYS;
+    options->exit_share = DEFAULT_EXIT_SHARE;
+    options->v_rate = DEFAULT_V_RATE;
+    options->f_rate = DEFAULT_F_RATE;
+    options->r_rate = DEFAULT_R_RATE;
+    options->skew = DEFAULT_SKEW;
+
+    while ((option = getopt(argc, argv, "s:n:p:k:d:x:v:f:r:z:")) != -1) {
+        switch (option) {
+            case 's': options->seed = strtoull(optarg, NULL, 10); break;
+            case 'n': options->commands = atol(optarg); break;
+            case 'p': options->parkings = atoi(optarg); break;
+            case 'k': options->plates = atoi(optarg); break;
+            case 'd': options->days = atoi(optarg); break;
+            case 'x': options->exit_share = atof(optarg); break;
+            case 'v': options->v_rate = atof(optarg); break;
+            case 'f': options->f_rate = atof(optarg); break;
+            case 'r': options->r_rate = atof(optarg); break;
+            case 'z': options->skew = atof(optarg); break;
+            default: return -1;
+        }
+    }
+
+    if (options->parkings <= 0 || options->plates <= 0 || options->days <= 0 ||
+        options->commands < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Generates the workload.
+ * @param argc Number of arguments.
+ * @param argv Arguments, the options.
+ * @return Returns 0 upon successful completion.
+ */
+int main(int argc, char *argv[]) {
+    workload_options options;
+    workload_state state;
+    long i;
+    int plate;
+    double kind, total = 0.0;
+
+    if (parse_options(argc, argv, &options) != 0) {
+        fprintf(stderr, "usage: %s [-s seed] [-n commands] [-p parkings] [-k plates] "
+            "[-d days] [-x exit share] [-v v rate] [-f f rate] [-r r rate] [-z skew]\n", argv[0]);
+        return 1;
+    }
+
+    state.state = options.seed * 0x9E3779B97F4A7C15ULL + 1;
+    state.popularity = (double *)malloc(sizeof(double) * options.plates);
+    state.parked_in = (int *)malloc(sizeof(int) * options.plates);
+    state.parked = (int *)malloc(sizeof(int) * options.plates);
+    state.parked_position = (int *)malloc(sizeof(int) * options.plates);
+    if (state.popularity == NULL || state.parked_in == NULL || state.parked == NULL ||
+        state.parked_position == NULL) {
+        fprintf(stderr, "Memory allocation of workload state failed\n");
+        return 1;
+    }
+    state.num_parked = 0;
+    state.minute = 0;
+
+    /** Plate i is chosen with a weight of 1 / (i + 1) ^ skew. */
+    for (i = 0; i < options.plates; i++) {
+        total += 1.0 / pow(i + 1, options.skew);
+        state.popularity[i] = total;
+        state.parked_in[i] = -1;
+    }
+
+    /** Parkings big enough to never be full. */
+    for (i = 0; i < options.parkings; i++) {
+        printf("p lot%ld %d 0.25 0.30 15.00\n", i, options.plates);
+    }
+
+    for (i = 0; i < options.commands; i++) {
+        /** Time moves forward so the commands span the given days. */
+        state.minute = (long)((double)i * options.days * MINUTES_IN_DAY /
+            (options.commands > 0 ? options.commands : 1));
+        kind = next_double(&state);
+
+        if (kind < options.v_rate) {
+            printf("v ");
+            print_plate(next_plate(&state, &options));
+            putchar('\n');
+
+        } else if (kind < options.v_rate + options.f_rate) {
+            printf("f lot%d", (int)(next_random(&state) % options.parkings));
+            /** Half of the queries ask for a single past day. */
+            if (next_random(&state) & 1) {
+                putchar(' ');
+                print_date(next_random(&state) % (state.minute / MINUTES_IN_DAY + 1) *
+                    MINUTES_IN_DAY, 0);
+            }
+            putchar('\n');
+
+        } else if (kind < options.v_rate + options.f_rate + options.r_rate) {
+            print_removal(&state, &options);
+
+        } else if (state.num_parked > 0 && next_double(&state) < options.exit_share) {
+            plate = state.parked[next_random(&state) % state.num_parked];
+            print_movement(&state, &options, plate, 1);
+
+        } else {
+            plate = next_plate(&state, &options);
+            print_movement(&state, &options, plate, state.parked_in[plate] >= 0);
+        }
+    }
+    printf("q\n");
+
+    free(state.popularity);
+    free(state.parked_in);
+    free(state.parked);
+    free(state.parked_position);
+    return 0;
+}
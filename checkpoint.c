@@ -0,0 +1,480 @@
+/**
+ * File with the checkpoints of the parkings.
+ * @file checkpoint.c
+ * @author ist1106369 Sophia Alencar
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "aux.h"
+#include "checkpoint.h"
+#include "shard.h"
+#include "wal.h"
+
+/**
+ * Adds bytes to a checksum, a word at a time. The bytes written at
+ * once must be a multiple of 8, so the checksum of the whole file is
+ * the same as the one of its parts.
+ * @param checksum The checksum so far.
+ * @param bytes The bytes.
+ * @param length The number of bytes.
+ * @return The new checksum.
+ */
+uint64_t add_checksum(uint64_t checksum, const void *bytes, size_t length) {
+    const char *cursor = (const char *)bytes;
+    uint64_t word;
+    size_t i;
+
+    for (i = 0; i + sizeof(word) <= length; i += sizeof(word)) {
+        memcpy(&word, cursor + i, sizeof(word));
+        checksum = (checksum ^ word) * CHECKSUM_PRIME;
+    }
+    if (i < length) {
+        word = 0;
+        memcpy(&word, cursor + i, length - i);
+        checksum = (checksum ^ word) * CHECKSUM_PRIME;
+    }
+    return checksum;
+}
+
+/**
+ * Writes bytes of the checkpoint after its header, adding them to the checksum.
+ * @param writer Pointer to the writer.
+ * @param bytes The bytes.
+ * @param length The number of bytes, a multiple of 8.
+ */
+static void write_section(checkpoint_writer *writer, const void *bytes, size_t length) {
+    writer->checksum = add_checksum(writer->checksum, bytes, length);
+    if (fwrite(bytes, 1, length, writer->stream) != length) {
+        writer->failed = 1;
+    }
+}
+
+/**
+ * Writes a vehicle log to the checkpoint.
+ * @param writer Pointer to the writer.
+ * @param current_log The log.
+ */
+static void write_log(checkpoint_writer *writer, vehicle_log *current_log) {
+    checkpoint_log record;
+
+    memset(&record, 0, sizeof(record));
+    record.license_plate = current_log->license_plate;
+    record.cost = current_log->exit_date != NO_DATE ? current_log->cost : 0;
+    record.entry_date = current_log->entry_date;
+    record.exit_date = current_log->exit_date;
+    write_section(writer, &record, sizeof(record));
+}
+
+/**
+ * Writes tariffs of a parking to the checkpoint, the oldest first, or
+ * only counts them.
+ * @param writer Pointer to the writer, NULL to only count the tariffs.
+ * @param current_tariff The newest tariff to write.
+ * @return Number of tariffs.
+ */
+static uint64_t write_tariffs(checkpoint_writer *writer, tariff *current_tariff) {
+    checkpoint_tariff record;
+    uint64_t count;
+
+    if (current_tariff == NULL) {
+        return 0;
+    }
+    count = write_tariffs(writer, current_tariff->next) + 1;
+    if (writer != NULL) {
+        memset(&record, 0, sizeof(record));
+        record.cost_x = current_tariff->cost_x;
+        record.cost_y = current_tariff->cost_y;
+        record.cost_z = current_tariff->cost_z;
+        record.effective_date = current_tariff->effective_date;
+        write_section(writer, &record, sizeof(record));
+    }
+    return count;
+}
+
+/**
+ * Writes the logs of a parking to the checkpoint, or only counts them:
+ * the closed ones in the order of their billing days, then the open ones.
+ * @param writer Pointer to the writer, NULL to only count the logs.
+ * @param my_parking The parking.
+ * @return Number of logs.
+ */
+static uint64_t write_parking_logs(checkpoint_writer *writer, parking *my_parking) {
+    parking_history *history;
+    vehicle_log *current_log;
+    uint64_t count = 0;
+    int i;
+
+    for (i = 0; i < my_parking->num_billing_days; i++) {
+        for (current_log = my_parking->billing_days[i].vehicle_log; current_log != NULL;
+            current_log = current_log->next_in_day) {
+            if (writer != NULL) {
+                write_log(writer, current_log);
+            }
+            count++;
+        }
+    }
+
+    /** A vehicle parked there has its last log in the parking open. */
+    for (history = my_parking->histories; history != NULL;
+        history = history->next_in_parking) {
+        if (history->last_log != NULL && history->last_log->exit_date == NO_DATE) {
+            if (writer != NULL) {
+                write_log(writer, history->last_log);
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * Flushes the directory of a file, so a file renamed there is durable.
+ * @param path Path of the file.
+ * @return 0 on success, -1 on failure.
+ */
+int sync_directory(const char *path) {
+    const char *slash = strrchr(path, '/');
+    size_t length = slash != NULL ? (size_t)(slash - path) + 1 : 1;
+    char *directory;
+    int descriptor, result = -1;
+
+    /** A path without a directory is in the current one. */
+    if ((directory = (char *)tracked_malloc(length + 1, ALLOC_STRING)) == NULL) {
+        return -1;
+    }
+    memcpy(directory, slash != NULL ? path : ".", length);
+    directory[length] = '\0';
+    if ((descriptor = open(directory, O_RDONLY)) >= 0) {
+        result = fsync(descriptor);
+        close(descriptor);
+    }
+    tracked_free(directory, length + 1, ALLOC_STRING);
+    return result;
+}
+
+/**
+ * Writes a checkpoint of the parkings that exist, with their logs, the
+ * last date and the last change logged. It is written to a temporary file that then replaces
+ * the old checkpoint, so a crash never leaves a checkpoint half written.
+ * @param parking_args Pointer to the args structure containing parking information.
+ * @param path Path of the checkpoint.
+ * @return 0 on success, -1 if it could not be written.
+ */
+int write_checkpoint(args *parking_args, const char *path) {
+    parking_registry *registry = &parking_args->registry;
+    checkpoint_header header;
+    checkpoint_parking record;
+    checkpoint_writer writer;
+    parking *my_parking;
+    char *temp_path, *names = NULL;
+    uint64_t names_size = 0, offset = 0;
+    size_t temp_size = strlen(path) + sizeof(CHECKPOINT_TEMP_SUFFIX), names_capacity;
+    int id;
+
+    /** The logs are only complete once the workers ran all their tasks
+     * (the W command already waited, between commands nothing is captured). */
+    if (parking_args->engine != NULL) {
+        wait_shard_workers(parking_args->engine);
+    }
+
+    for (id = 0; id < registry->num_ids; id++) {
+        if (registry->parkings[id] != NULL) {
+            names_size += strlen(registry->parkings[id]->name) + 1;
+        }
+    }
+    names_size = (names_size + 7) & ~(uint64_t)7;
+    names_capacity = names_size > 0 ? names_size : 1;
+
+    if ((temp_path = (char *)tracked_malloc(temp_size, ALLOC_STRING)) == NULL ||
+        (names = (char *)tracked_calloc(names_capacity, 1, ALLOC_BUFFER)) == NULL) {
+        tracked_free(temp_path, temp_size, ALLOC_STRING);
+        return -1;
+    }
+    strcpy(temp_path, path);
+    strcat(temp_path, CHECKPOINT_TEMP_SUFFIX);
+    if ((writer.stream = fopen(temp_path, "wb")) == NULL) {
+        tracked_free(temp_path, temp_size, ALLOC_STRING);
+        tracked_free(names, names_capacity, ALLOC_BUFFER);
+        return -1;
+    }
+    writer.checksum = CHECKSUM_SEED;
+    writer.failed = 0;
+
+    /** The header is written again at the end, with the checksum. */
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.format = CHECKPOINT_FORMAT;
+    header.byte_order = CHECKPOINT_BYTE_ORDER;
+    header.num_parkings = registry->num_parkings;
+    header.names_size = names_size;
+    header.last_sequence = parking_args->last_sequence;
+    header.last_date = parking_args->last_date;
+    if (fwrite(&header, sizeof(header), 1, writer.stream) != 1) {
+        writer.failed = 1;
+    }
+
+    /** The parkings in id order, with the number of their logs. */
+    for (id = 0; id < registry->num_ids; id++) {
+        if ((my_parking = registry->parkings[id]) == NULL) {
+            continue;
+        }
+        memset(&record, 0, sizeof(record));
+        record.num_tariffs = write_tariffs(NULL, my_parking->tariffs);
+        record.num_logs = write_parking_logs(NULL, my_parking);
+        record.name_offset = (uint32_t)offset;
+        record.name_length = (uint32_t)strlen(my_parking->name);
+        record.max_capacity = my_parking->max_capacity;
+        record.free_spaces = my_parking->free_spaces;
+        write_section(&writer, &record, sizeof(record));
+
+        memcpy(names + offset, my_parking->name, record.name_length);
+        offset += record.name_length + 1;
+        header.num_tariffs += record.num_tariffs;
+        header.num_logs += record.num_logs;
+    }
+
+    for (id = 0; id < registry->num_ids; id++) {
+        if (registry->parkings[id] != NULL) {
+            write_tariffs(&writer, registry->parkings[id]->tariffs);
+        }
+    }
+    for (id = 0; id < registry->num_ids; id++) {
+        if (registry->parkings[id] != NULL) {
+            write_parking_logs(&writer, registry->parkings[id]);
+        }
+    }
+    write_section(&writer, names, names_size);
+
+    header.checksum = writer.checksum;
+    if (fseek(writer.stream, 0, SEEK_SET) != 0 ||
+        fwrite(&header, sizeof(header), 1, writer.stream) != 1) {
+        writer.failed = 1;
+    }
+
+    /** Make the file durable before it replaces the old checkpoint. */
+    if (fflush(writer.stream) != 0 || fsync(fileno(writer.stream)) != 0) {
+        writer.failed = 1;
+    }
+    if (fclose(writer.stream) != 0) {
+        writer.failed = 1;
+    }
+    if (writer.failed || rename(temp_path, path) != 0 || sync_directory(path) != 0) {
+        remove(temp_path);
+        writer.failed = 1;
+    }
+
+    /** The changes logged so far are in the checkpoint the log starts
+     * from, so they are dropped (the ones left by a crash are skipped). */
+    if (!writer.failed && parking_args->wal != NULL && parking_args->checkpoint_path != NULL &&
+        strcmp(path, parking_args->checkpoint_path) == 0) {
+        reset_wal(parking_args->wal);
+    }
+
+    tracked_free(temp_path, temp_size, ALLOC_STRING);
+    tracked_free(names, names_capacity, ALLOC_BUFFER);
+    return writer.failed ? -1 : 0;
+}
+
+/**
+ * Checks that a mapped checkpoint is complete and not corrupted.
+ * @param bytes The checkpoint.
+ * @param size Size of the checkpoint.
+ * @return 1 if it is valid, otherwise 0.
+ */
+static int is_checkpoint_valid(const char *bytes, size_t size) {
+    const checkpoint_header *header = (const checkpoint_header *)bytes;
+    const checkpoint_parking *parkings;
+    const char *names;
+    uint64_t body, tariffs = 0, logs = 0, i;
+
+    if (size < sizeof(*header) ||
+        memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) != 0 ||
+        header->format != CHECKPOINT_FORMAT || header->byte_order != CHECKPOINT_BYTE_ORDER) {
+        return 0;
+    }
+
+    /** The sections fill the file exactly. */
+    body = size - sizeof(*header);
+    if (header->num_parkings > body / sizeof(checkpoint_parking) ||
+        header->num_tariffs > body / sizeof(checkpoint_tariff) ||
+        header->num_logs > body / sizeof(checkpoint_log) ||
+        header->num_parkings * sizeof(checkpoint_parking) +
+        header->num_tariffs * sizeof(checkpoint_tariff) +
+        header->num_logs * sizeof(checkpoint_log) + header->names_size != body ||
+        add_checksum(CHECKSUM_SEED, bytes + sizeof(*header), body) != header->checksum) {
+        return 0;
+    }
+
+    /** Each name ends in the names, each parking has the tariff of its
+     * creation, and the tariffs and the logs add up. */
+    parkings = (const checkpoint_parking *)(bytes + sizeof(*header));
+    names = bytes + size - header->names_size;
+    for (i = 0; i < header->num_parkings; i++) {
+        if ((uint64_t)parkings[i].name_offset + parkings[i].name_length >= header->names_size ||
+            memchr(names + parkings[i].name_offset, '\0', parkings[i].name_length + 1) !=
+            names + parkings[i].name_offset + parkings[i].name_length ||
+            parkings[i].num_tariffs == 0 ||
+            parkings[i].num_tariffs > header->num_tariffs - tariffs ||
+            parkings[i].num_logs > header->num_logs - logs) {
+            return 0;
+        }
+        tariffs += parkings[i].num_tariffs;
+        logs += parkings[i].num_logs;
+    }
+    return tariffs == header->num_tariffs && logs == header->num_logs;
+}
+
+/**
+ * Loads the tariffs of a parking from a checkpoint, after the one of its creation.
+ * @param my_parking The parking, with the tariff of its creation.
+ * @param tariffs The tariffs after it, the oldest first.
+ * @param count Number of tariffs.
+ * @return 0 on success, -1 if memory ran out.
+ */
+static int load_parking_tariffs(parking *my_parking, const checkpoint_tariff *tariffs,
+    uint64_t count) {
+    tariff *new_tariff;
+    uint64_t i;
+
+    for (i = 0; i < count; i++) {
+        if ((new_tariff = create_tariff(tariffs[i].effective_date, tariffs[i].cost_x,
+            tariffs[i].cost_y, tariffs[i].cost_z)) == NULL) {
+            return -1;
+        }
+        insert_tariff(my_parking, new_tariff);
+    }
+    return 0;
+}
+
+/**
+ * Loads the logs of a parking from a checkpoint, creating the vehicles
+ * and their histories, and adding the closed logs to the billing days.
+ * @param parking_args Pointer to the args structure containing parking information.
+ * @param my_parking The parking.
+ * @param logs The logs of the parking.
+ * @param count Number of logs.
+ * @return 0 on success, -1 if a log is not valid or memory ran out.
+ */
+static int load_parking_logs(args *parking_args, parking *my_parking,
+    const checkpoint_log *logs, uint64_t count) {
+    vehicle *my_vehicle;
+    parking_history *history;
+    vehicle_log *new_log;
+    uint64_t i;
+
+    for (i = 0; i < count; i++) {
+        if (logs[i].license_plate == EMPTY_KEY) {
+            return -1;
+        }
+        if (((my_vehicle = find_vehicle(parking_args->vehicles, logs[i].license_plate)) == NULL &&
+            (my_vehicle = add_new_vehicle(parking_args->vehicles, logs[i].license_plate)) == NULL) ||
+            (history = find_parking_history(my_vehicle, my_parking)) == NULL ||
+            (new_log = append_vehicle_log(history, logs[i].entry_date, 0)) == NULL) {
+            return -1;
+        }
+
+        /** The open log of a parked vehicle is its last entry. */
+        if (!my_vehicle->is_parked) {
+            my_vehicle->last_history = history;
+        }
+        if (logs[i].exit_date == NO_DATE) {
+            my_vehicle->is_parked = 1;
+            my_vehicle->parking_id = my_parking->id;
+            continue;
+        }
+
+        new_log->exit_date = logs[i].exit_date;
+        new_log->cost = logs[i].cost;
+        new_log->exit_version = 0;
+        add_new_exit(my_parking, new_log);
+    }
+    return 0;
+}
+
+/**
+ * Loads a checkpoint into empty args, mapping it into memory.
+ * @param parking_args Pointer to the args structure, with no parkings yet.
+ * @param path Path of the checkpoint.
+ * @return 0 on success, 1 if there is no checkpoint, -1 if it is not
+ * valid or could not be loaded.
+ */
+int load_checkpoint(args *parking_args, const char *path) {
+    const checkpoint_header *header;
+    const checkpoint_parking *parkings;
+    const checkpoint_tariff *tariffs;
+    const checkpoint_log *logs;
+    const char *bytes, *names;
+    parking *my_parking;
+    struct stat status;
+    void *map;
+    uint64_t i;
+    int descriptor, result = 0;
+
+    if ((descriptor = open(path, O_RDONLY)) < 0) {
+        return errno == ENOENT ? 1 : -1;
+    }
+    if (fstat(descriptor, &status) != 0 || status.st_size < (off_t)sizeof(*header) ||
+        (map = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0)) == MAP_FAILED) {
+        close(descriptor);
+        return -1;
+    }
+    close(descriptor);
+    madvise(map, status.st_size, MADV_SEQUENTIAL);
+
+    bytes = (const char *)map;
+    if (!is_checkpoint_valid(bytes, status.st_size)) {
+        munmap(map, status.st_size);
+        return -1;
+    }
+    header = (const checkpoint_header *)bytes;
+    parkings = (const checkpoint_parking *)(bytes + sizeof(*header));
+    tariffs = (const checkpoint_tariff *)(parkings + header->num_parkings);
+    logs = (const checkpoint_log *)(tariffs + header->num_tariffs);
+    names = bytes + status.st_size - header->names_size;
+
+    for (i = 0; i < header->num_parkings && result == 0; i++) {
+        if (add_new_parking(parking_args, (char *)names + parkings[i].name_offset,
+            parkings[i].max_capacity, tariffs[0].cost_x, tariffs[0].cost_y,
+            tariffs[0].cost_z) != 0 || parkings[i].free_spaces < 0 ||
+            parkings[i].free_spaces > parkings[i].max_capacity) {
+            result = -1;
+            break;
+        }
+        my_parking = find_parking(parking_args, (char *)names + parkings[i].name_offset);
+        my_parking->free_spaces = parkings[i].free_spaces;
+        if ((result = load_parking_tariffs(my_parking, tariffs + 1,
+            parkings[i].num_tariffs - 1)) == 0) {
+            result = load_parking_logs(parking_args, my_parking, logs, parkings[i].num_logs);
+        }
+        tariffs += parkings[i].num_tariffs;
+        logs += parkings[i].num_logs;
+    }
+    parking_args->last_date = header->last_date;
+    parking_args->last_sequence = header->last_sequence;
+
+    munmap(map, status.st_size);
+    return result;
+}
+
+/**
+ * Writes a checkpoint to the file of the W command, or to the
+ * checkpoint file of the args if it has none.
+ * @param parking_args Pointer to the args structure containing parking information.
+ * @param line Command line containing the optional path.
+ */
+void save_checkpoint(args *parking_args, command_line *line) {
+    const char *path = line->name != NULL ? line->name : parking_args->checkpoint_path;
+
+    if (path == NULL) {
+        fprintf(stderr, "W: no checkpoint file\n");
+        return;
+    }
+    if (write_checkpoint(parking_args, path) != 0) {
+        fprintf(stderr, "%s: could not write checkpoint\n", path);
+    }
+}
@@ -0,0 +1,90 @@
+/**
+ * File with the checkpoints: binary snapshots of the parkings, their
+ * tariffs, vehicle logs and billing days, written on demand or periodically and
+ * mapped into memory at startup instead of replaying the commands.
+ * @file checkpoint.h
+ * @author ist1106369 Sophia Alencar
+*/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "proj1.h"
+
+/** Characters at the start of a checkpoint. */
+#define CHECKPOINT_MAGIC "PARKCKPT"
+
+/** Number of the checkpoint format, changed when the layout changes. */
+#define CHECKPOINT_FORMAT 4
+
+/** Marker of the byte order of the writer, the layout is not portable. */
+#define CHECKPOINT_BYTE_ORDER 0x01020304u
+
+/** Suffix of the file a checkpoint is written to before replacing the old one. */
+#define CHECKPOINT_TEMP_SUFFIX ".tmp"
+
+/** Start and multiplier of the checksum (the ones of FNV-1a, on words). */
+#define CHECKSUM_SEED 0xCBF29CE484222325ULL
+#define CHECKSUM_PRIME 0x100000001B3ULL
+
+/** Structs. */
+
+/** The file is the header, the parkings, the tariffs and the logs of
+ * each parking in order and the names, each ending with a '\0' and
+ * padded to 8 bytes. */
+typedef struct {
+    char magic[8];                  /**< CHECKPOINT_MAGIC, without the '\0'. */
+    uint32_t format;                /**< CHECKPOINT_FORMAT. */
+    uint32_t byte_order;            /**< CHECKPOINT_BYTE_ORDER. */
+    uint64_t num_parkings;          /**< Number of parkings. */
+    uint64_t num_tariffs;           /**< Number of tariffs. */
+    uint64_t num_logs;              /**< Number of vehicle logs. */
+    uint64_t names_size;            /**< Size of the names, padded. */
+    uint64_t checksum;              /**< Checksum of everything after the header. */
+    uint64_t last_sequence;         /**< Sequence number of the last change logged before it. */
+    timestamp last_date;            /**< Last date recorded, NO_DATE if none. */
+    uint32_t padding;               /**< Zero. */
+} checkpoint_header;
+
+typedef struct {
+    uint64_t num_tariffs;           /**< Number of tariffs of the parking, at least 1. */
+    uint64_t num_logs;              /**< Number of logs of the parking. */
+    uint32_t name_offset;           /**< Offset of the name in the names. */
+    uint32_t name_length;           /**< Length of the name, without the '\0'. */
+    int32_t max_capacity;           /**< Maximum capacity of the parking. */
+    int32_t free_spaces;            /**< Number of free parking spaces. */
+} checkpoint_parking;
+
+/** The tariffs of a parking are the oldest first, the first one is the
+ * one of its creation. */
+typedef struct {
+    money cost_x, cost_y, cost_z;   /**< Costs of the tariff, in cents. */
+    timestamp effective_date;       /**< First exit date it charges. */
+    uint32_t padding;               /**< Zero. */
+} checkpoint_tariff;
+
+/** The logs of a parking are the closed ones in the order of their
+ * billing days, then the open ones, so loading them again in order
+ * gives the same billing days and the same histories. */
+typedef struct {
+    plate license_plate;            /**< License plate of the vehicle. */
+    money cost;                     /**< Cost of parking in cents, 0 while parked. */
+    timestamp entry_date;           /**< Entry date of the vehicle. */
+    timestamp exit_date;            /**< Exit date of the vehicle, NO_DATE while parked. */
+} checkpoint_log;
+
+typedef struct {
+    FILE *stream;                   /**< Stream of the temporary file. */
+    uint64_t checksum;              /**< Checksum of the bytes after the header so far. */
+    int failed;                     /**< Flag indicating a write failed. */
+} checkpoint_writer;
+
+
+/** Checkpoint functions. */
+uint64_t add_checksum(uint64_t checksum, const void *bytes, size_t length);
+int sync_directory(const char *path);
+int write_checkpoint(args *parking_args, const char *path);
+int load_checkpoint(args *parking_args, const char *path);
+void save_checkpoint(args *parking_args, command_line *line);
+
+#endif // CHECKPOINT_H
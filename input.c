@@ -0,0 +1,225 @@
+/**
+ * File with the block based command reader.
+ * @file input.c
+ * @author ist1106369 Sophia Alencar
+*/
+
+#include "input.h"
+#include "stats.h"
+
+/**
+ * Initializes a reader over the given stream.
+ * @param reader Pointer to the reader to initialize.
+ * @param stream Stream the commands are read from.
+ * @return Returns 0 on success, -1 if the buffer could not be allocated.
+ */
+int initialize_reader(input_reader *reader, FILE *stream) {
+    reader->stream = stream;
+    reader->size = READ_BLOCK_SIZE;
+    reader->start = 0;
+    reader->end = 0;
+    reader->saved_position = 0;
+    reader->saved_char = '\0';
+    reader->eof = 0;
+
+    /** One extra byte so the last line can always be terminated. */
+    if ((reader->block = (char *)tracked_malloc(reader->size + 1, ALLOC_INPUT)) == NULL) {
+        fprintf(stderr, "Memory allocation of input block failed\n");
+        return -1;
+    }
+    reader->block[0] = '\0';
+    return 0;
+}
+
+/**
+ * Reads the next block of the stream into the reader buffer, moving
+ * the unread bytes to the beginning and growing it if a line does not fit.
+ * @param reader Pointer to the reader.
+ * @return Returns 0 on success, -1 if the buffer could not grow.
+ */
+static int fill_block(input_reader *reader) {
+    size_t remaining = reader->end - reader->start, bytes_read;
+    char *new_block;
+
+    /** Move the unread bytes to the beginning of the buffer. */
+    if (reader->start > 0) {
+        memmove(reader->block, reader->block + reader->start, remaining);
+        reader->start = 0;
+        reader->end = remaining;
+    }
+
+    /** A single line fills the whole buffer, so double its size. */
+    if (reader->end == reader->size) {
+        if ((new_block = (char *)tracked_realloc(reader->block,
+            reader->size + 1, reader->size * 2 + 1, ALLOC_INPUT)) == NULL) {
+            fprintf(stderr, "Memory allocation of input block failed\n");
+            return -1;
+        }
+        reader->block = new_block;
+        reader->size *= 2;
+    }
+
+    bytes_read = fread(reader->block + reader->end, 1,
+        reader->size - reader->end, reader->stream);
+    reader->end += bytes_read;
+
+    if (bytes_read == 0) {
+        reader->eof = 1;
+    }
+    return 0;
+}
+
+/**
+ * Reads the next command from the stream. As with getchar followed by
+ * fgets, the first byte is the command and the rest of the line
+ * (up to and including the '\n') are its arguments.
+ * The arguments are split in place, no bytes are copied.
+ * @param reader Pointer to the reader.
+ * @param line Pointer to the command line to fill.
+ * @return Returns 1 if a command was read, 0 at the end of the stream.
+ */
+int read_command(input_reader *reader, command_line *line) {
+    char *newline;
+    size_t line_end;
+
+    /** Restore the byte that terminated the previous line. */
+    reader->block[reader->saved_position] = reader->saved_char;
+
+    while (1) {
+        if (reader->end - reader->start > 1) {
+            newline = memchr(reader->block + reader->start + 1, '\n',
+                reader->end - reader->start - 1);
+            if (newline != NULL) {
+                line_end = newline - reader->block + 1;
+                break;
+            }
+        }
+
+        /** Without a final '\n' the line ends with the stream. */
+        if (reader->eof) {
+            if (reader->start >= reader->end) {
+                return 0;
+            }
+            line_end = reader->end;
+            break;
+        }
+
+        if (fill_block(reader) != 0) {
+            return 0;
+        }
+    }
+
+    line->command = reader->block[reader->start];
+
+    /** Terminate the line, saving the first byte of the next one. */
+    reader->saved_position = line_end;
+    reader->saved_char = reader->block[line_end];
+    reader->block[line_end] = '\0';
+
+    split_command(line, reader->block + reader->start + 1,
+        line_end - reader->start - 1);
+    reader->start = line_end;
+
+    return 1;
+}
+
+/**
+ * Frees the memory used by a reader.
+ * @param reader Pointer to the reader.
+ */
+void free_reader(input_reader *reader) {
+    tracked_free(reader->block, reader->size + 1, ALLOC_INPUT);
+    reader->block = NULL;
+}
+
+/**
+ * Finds the next token of a string, with the same behaviour as strtok
+ * but keeping the position in a cursor instead of a static variable.
+ * @param cursor Pointer to the position where the search starts,
+ * updated to the position after the token.
+ * @param delimiters Characters that separate the tokens.
+ * @return The token found, or NULL if there are no more tokens.
+ */
+char *next_token(char **cursor, const char *delimiters) {
+    char *token = *cursor + strspn(*cursor, delimiters);
+    char *token_end;
+
+    if (*token == '\0') {
+        *cursor = token;
+        return NULL;
+    }
+
+    token_end = token + strcspn(token, delimiters);
+    if (*token_end != '\0') {
+        *token_end = '\0';
+        token_end++;
+    }
+    *cursor = token_end;
+
+    return token;
+}
+
+/**
+ * Extracts the name from the given buffer.
+ * @param buffer The input string from which to extract the name.
+ * @param length The length of the input string.
+ * @param cursor Pointer to the position after the name.
+ * @return The extracted name, or NULL if no name is found.
+ */
+char *parse_name(char *buffer, size_t length, char **cursor) {
+    *cursor = buffer;
+
+    /** Check if the buffer contains a double quote character. */
+    if (memchr(buffer, '"', length)) {
+        /** Discard the first part of the string until the first double quote. */
+        next_token(cursor, "\"");
+        /** Extract the token enclosed within double quotes. */
+        return next_token(cursor, "\"");
+    }
+
+    /** If there are no double quotes in the buffer, tokenize using the regular delimiter. */
+    return next_token(cursor, DELIMITER);
+}
+
+/**
+ * Splits the arguments of a command into the name and the tokens after it.
+ * @param line Pointer to the command line with the command already set.
+ * @param rest The arguments of the command.
+ * @param length The length of the arguments.
+ */
+void split_command(command_line *line, char *rest, size_t length) {
+    char *cursor = rest, *token;
+
+    line->name = NULL;
+    line->num_tokens = 0;
+
+    switch (line->command) {
+        case 'p': case 'e': case 's': case 'f': case 't': case 'r': case 'W': case 'c':
+            line->name = parse_name(rest, length, &cursor);
+            break;
+
+        case 'v': case 'R':
+            break;
+
+        default:
+            return;
+    }
+
+    while (line->num_tokens < MAX_TOKENS &&
+        (token = next_token(&cursor, DELIMITER)) != NULL) {
+        line->tokens[line->num_tokens++] = token;
+    }
+}
+
+/**
+ * Gets a token of a command line.
+ * @param line Pointer to the command line.
+ * @param index Index of the token after the name.
+ * @return The token, or NULL if the command has less tokens.
+ */
+char *get_token(command_line *line, int index) {
+    if (index >= line->num_tokens) {
+        return NULL;
+    }
+    return line->tokens[index];
+}
@@ -0,0 +1,56 @@
+/**
+ * File with the block based command reader.
+ * @file input.h
+ * @author ist1106369 Sophia Alencar
+*/
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Size of each block read from the input stream. */
+#define READ_BLOCK_SIZE (1 << 20)
+
+/** Delimeter for parsing purposes. */
+#define DELIMITER " \t\n"
+
+/** Max number of tokens kept after the name of a command. */
+#define MAX_TOKENS 8
+
+/** Structs. */
+
+typedef struct {
+    FILE *stream;           /**< Stream the commands are read from. */
+    char *block;            /**< Buffer holding the bytes read so far. */
+    size_t size;            /**< Capacity of the buffer. */
+    size_t start;           /**< Position of the first unread byte. */
+    size_t end;             /**< Position after the last byte read. */
+    size_t saved_position;  /**< Position of the byte replaced by '\0'. */
+    char saved_char;        /**< Byte replaced by '\0' at the end of a line. */
+    int eof;                /**< Flag indicating the stream has ended. */
+} input_reader;
+
+typedef struct {
+    char command;               /**< Character of the command. */
+    char *name;                 /**< Name token (parking name), if any. */
+    char *tokens[MAX_TOKENS];   /**< Tokens that follow the name. */
+    int num_tokens;             /**< Number of tokens found. */
+} command_line;
+
+
+/** Reader functions. */
+int initialize_reader(input_reader *reader, FILE *stream);
+int read_command(input_reader *reader, command_line *line);
+void free_reader(input_reader *reader);
+
+
+/** Tokenizer functions. */
+char *next_token(char **cursor, const char *delimiters);
+char *parse_name(char *buffer, size_t length, char **cursor);
+void split_command(command_line *line, char *rest, size_t length);
+char *get_token(command_line *line, int index);
+
+#endif // INPUT_H
@@ -5,66 +5,165 @@
 */
 
 #include "aux.h"
+#include "checkpoint.h"
+#include "shard.h"
+#include "wal.h"
 
 /** Main funtion of the management system that reads
- * commands from stdin and and calls the corresponding functions.
+ * commands from stdin (or from the file given as argument)
+ * and calls the corresponding functions.
+ * With -s the statistics of the commands are printed to stderr at the end,
+ * and with -m also their allocations and the memory of each structure.
+ * With -j the parkings are split among that number of worker threads,
+ * and with -r the v and f reports run from a snapshot on that number of
+ * reporting threads, so they do not delay the other commands.
+ * With -d the parkings start from that checkpoint file if it exists, the
+ * W command writes it, and with -w it is also written every that number
+ * of commands.
+ * With -l the changes accepted are logged to that file, which is replayed
+ * on top of the checkpoint at startup, and emptied with each checkpoint.
+ * @param argc Number of arguments.
+ * @param argv Arguments, optionally -s or -m, -j and the number of workers,
+ * -r and the number of reporting threads, -d and the checkpoint file, -w
+ * and the number of commands between checkpoints, -l and the log file,
+ * and the path of the input file.
  * @return Returns 0 upon successful completion.
  */
-int main() {
-	char command, *buffer;
+int main(int argc, char *argv[]) {
+	FILE *stream = stdin;
+	input_reader reader;
+	command_line line;
 	args *parking_args;
+	const char *checkpoint_path = NULL, *wal_path = NULL;
+	long checkpoint_interval = 0, commands = 0;
+	int first_arg = 1, num_workers = 0, num_reporters = 0;
+
+	/** Collect the statistics of the commands, and of their allocations. */
+	if (argc > first_arg && strcmp(argv[first_arg], "-s") == 0) {
+		enable_stats();
+		first_arg++;
+	} else if (argc > first_arg && strcmp(argv[first_arg], "-m") == 0) {
+		enable_alloc_stats();
+		first_arg++;
+	}
+
+	/** Run the parkings on worker threads, the allocations are only
+	 * tracked on the main thread. */
+	if (argc > first_arg + 1 && strcmp(argv[first_arg], "-j") == 0) {
+		num_workers = atoi(argv[first_arg + 1]);
+		if (num_workers < 1 || num_workers > MAX_WORKERS || alloc_stats_enabled) {
+			fprintf(stderr, "-j: the number of workers must be from 1 to %d, "
+				"without -m\n", MAX_WORKERS);
+			return 1;
+		}
+		first_arg += 2;
+	}
+
+	/** Run the reports on reporting threads, besides the workers. */
+	if (argc > first_arg + 1 && strcmp(argv[first_arg], "-r") == 0) {
+		num_reporters = atoi(argv[first_arg + 1]);
+		if (num_reporters < 1 || num_reporters > MAX_REPORTERS || num_workers == 0) {
+			fprintf(stderr, "-r: the number of reporting threads must be from 1 to %d, "
+				"after -j\n", MAX_REPORTERS);
+			return 1;
+		}
+		first_arg += 2;
+	}
+
+	/** Start from a checkpoint, and write it periodically. */
+	if (argc > first_arg + 1 && strcmp(argv[first_arg], "-d") == 0) {
+		checkpoint_path = argv[first_arg + 1];
+		first_arg += 2;
+	}
+	if (argc > first_arg + 1 && strcmp(argv[first_arg], "-w") == 0) {
+		checkpoint_interval = atol(argv[first_arg + 1]);
+		if (checkpoint_interval < 1 || checkpoint_path == NULL) {
+			fprintf(stderr, "-w: the number of commands must be positive, after -d\n");
+			return 1;
+		}
+		first_arg += 2;
+	}
+
+	/** Log the changes. */
+	if (argc > first_arg + 1 && strcmp(argv[first_arg], "-l") == 0) {
+		wal_path = argv[first_arg + 1];
+		first_arg += 2;
+	}
+
+	/** Read from the given file instead of stdin. */
+	if (argc > first_arg && (stream = fopen(argv[first_arg], "rb")) == NULL) {
+		fprintf(stderr, "%s: could not open input file\n", argv[first_arg]);
+		return 1;
+	}
 
 	/** Memory allocations. */
-	if((buffer = (char*)malloc(sizeof(char) * BUFSIZ + 1)) == NULL){
-        fprintf(stderr,"Memory allocation of buffer failed\n");
-        return 0;
-	} 
+	if (initialize_reader(&reader, stream) != 0) {
+		return 0;
+	}
 
-	if((parking_args = (args *)malloc(sizeof(args))) == NULL){
+	if((parking_args = (args *)tracked_malloc(sizeof(args), ALLOC_OTHER)) == NULL){
         fprintf(stderr,"Memory allocation of parking args failed\n");
         return 0;
 	}
-	
+
 	/** Initialize arguments. */
 	initialize_parking_list(parking_args);
 	initialize_hashtable(parking_args);
+	initialize_calendar();
 
-	/** Loop until 'q' command is encountered. */
-	while((command = getchar()) != 'q') {
-		fgets(buffer, BUFSIZ,stdin);
-		switch (command) {
-
-			case 'p':
-				list_or_add_park(parking_args, buffer);
-				break;
+	if (num_workers > 0 &&
+		(parking_args->engine = start_shard_engine(num_workers, num_reporters)) == NULL) {
+		fprintf(stderr, "Starting the workers failed\n");
+		return 1;
+	}
 
-			case 'e':
-				register_entry(parking_args, buffer);
-				break;
+	/** The reports look up vehicles and read the parkings while they change. */
+	if (num_reporters > 0) {
+		share_hashtable(parking_args->vehicles);
+	}
 
-			case 's':
-				register_exit(parking_args,buffer);
-				break;
+	/** Load the checkpoint, a missing one is an empty system. */
+	parking_args->checkpoint_path = checkpoint_path;
+	if (checkpoint_path != NULL && load_checkpoint(parking_args, checkpoint_path) < 0) {
+		fprintf(stderr, "%s: could not load checkpoint\n", checkpoint_path);
+		return 1;
+	}
 
-			case 'v':
-				list_vehicle_logs(parking_args, buffer);
-				break;
+	/** Replay the changes logged after the checkpoint, and log the new ones. */
+	if (wal_path != NULL && open_wal(parking_args, wal_path) == NULL) {
+		fprintf(stderr, "%s: could not recover from log\n", wal_path);
+		return 1;
+	}
 
-			case 'f':
-				show_revenue(parking_args, buffer);
-				break;
+	/** Loop until 'q' command (or the end of the input) is encountered. */
+	while (read_command(&reader, &line) && line.command != 'q') {
+		execute_command(parking_args, &line);
+		if (checkpoint_interval > 0 && ++commands % checkpoint_interval == 0 &&
+			write_checkpoint(parking_args, checkpoint_path) != 0) {
+			fprintf(stderr, "%s: could not write checkpoint\n", checkpoint_path);
+		}
+	}
 
-			case 'r':
-				remove_parking(parking_args,buffer);
-				break;
+	/** Write the output still buffered, waiting for the workers. */
+	if (parking_args->engine != NULL) {
+		stop_shard_engine(parking_args->engine);
+		parking_args->engine = NULL;
+	}
+	flush_output();
+	if (parking_args->wal != NULL) {
+		close_wal(parking_args->wal);
+		parking_args->wal = NULL;
+	}
 
-			default:
-				break;
-		}
+	if (stats_enabled) {
+		print_stats(stderr);
 	}
 
 	/** Free memory of used variables to avoid memory leaks. */
 	free_parking_args(parking_args);
-	free(buffer);
+	free_reader(&reader);
+	if (stream != stdin) {
+		fclose(stream);
+	}
 	return 0;
 }
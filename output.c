@@ -0,0 +1,233 @@
+/**
+ * File with the buffered output writer.
+ * @file output.c
+ * @author ist1106369 Sophia Alencar
+*/
+
+#include "output.h"
+#include "stats.h"
+
+/** Buffer with the output not yet written to stdout. */
+static char output_block[OUTPUT_BLOCK_SIZE];
+
+/** Number of bytes in the output buffer. */
+static size_t output_length = 0;
+
+/** Buffer capturing the output of each thread, NULL to write to stdout. */
+static __thread output_buffer *captured_output = NULL;
+
+/** Function run before any output is written to stdout, NULL if none. */
+static void (*output_barrier)(void *context) = NULL;
+
+/** Argument of the output barrier. */
+static void *barrier_context = NULL;
+
+/**
+ * Makes the output of the calling thread go to a buffer instead of
+ * stdout, so it can be written later in order.
+ * @param buffer Pointer to the buffer, or NULL to write to stdout again.
+ */
+void capture_output(output_buffer *buffer) {
+    captured_output = buffer;
+}
+
+/**
+ * Sets a function to run before any output is written to stdout, so
+ * what the output reports can be made durable first.
+ * @param barrier The function, or NULL for none.
+ * @param context Argument of the function.
+ */
+void set_output_barrier(void (*barrier)(void *context), void *context) {
+    output_barrier = barrier;
+    barrier_context = context;
+}
+
+/**
+ * Writes bytes to stdout, after running the output barrier.
+ * @param bytes The bytes to write.
+ * @param length The number of bytes.
+ */
+static void write_stdout(const char *bytes, size_t length) {
+    if (output_barrier != NULL) {
+        output_barrier(barrier_context);
+    }
+    fwrite(bytes, 1, length, stdout);
+}
+
+/**
+ * Adds bytes to the buffer capturing the output, doubling it when full.
+ * @param bytes The bytes to add.
+ * @param length The number of bytes.
+ */
+static void capture_bytes(const char *bytes, size_t length) {
+    output_buffer *buffer = captured_output;
+    size_t new_capacity = buffer->capacity > 0 ? buffer->capacity : INITIAL_CAPTURE_SIZE;
+    char *new_bytes;
+
+    if (buffer->length + length > buffer->capacity) {
+        while (buffer->length + length > new_capacity) {
+            new_capacity *= 2;
+        }
+        if ((new_bytes = (char *)tracked_realloc(buffer->bytes, buffer->capacity,
+            new_capacity, ALLOC_BUFFER)) == NULL) {
+            fprintf(stderr, "Memory allocation of captured output failed\n");
+            return;
+        }
+        buffer->bytes = new_bytes;
+        buffer->capacity = new_capacity;
+    }
+    memcpy(buffer->bytes + buffer->length, bytes, length);
+    buffer->length += length;
+}
+
+/**
+ * Writes the output buffer to stdout.
+ */
+void flush_output(void) {
+    if (output_length > 0) {
+        write_stdout(output_block, output_length);
+        output_length = 0;
+    }
+    fflush(stdout);
+}
+
+/**
+ * Adds bytes to the output buffer.
+ * @param bytes The bytes to add.
+ * @param length The number of bytes.
+ */
+void output_bytes(const char *bytes, size_t length) {
+    if (captured_output != NULL) {
+        capture_bytes(bytes, length);
+        return;
+    }
+    if (output_length + length > OUTPUT_BLOCK_SIZE) {
+        write_stdout(output_block, output_length);
+        output_length = 0;
+
+        /** Bytes that would not fit in the empty buffer go directly to stdout. */
+        if (length > OUTPUT_BLOCK_SIZE) {
+            write_stdout(bytes, length);
+            return;
+        }
+    }
+    memcpy(output_block + output_length, bytes, length);
+    output_length += length;
+}
+
+/**
+ * Adds a string to the output buffer, "(null)" if there is none (like printf).
+ * @param string The string to add.
+ */
+void output_string(const char *string) {
+    if (string == NULL) {
+        string = "(null)";
+    }
+    output_bytes(string, strlen(string));
+}
+
+/**
+ * Adds a character to the output buffer.
+ * @param character The character to add.
+ */
+void output_char(char character) {
+    if (captured_output != NULL) {
+        capture_bytes(&character, 1);
+        return;
+    }
+    if (output_length == OUTPUT_BLOCK_SIZE) {
+        write_stdout(output_block, output_length);
+        output_length = 0;
+    }
+    output_block[output_length++] = character;
+}
+
+/**
+ * Adds an integer to the output buffer, padded with zeros
+ * to the given width (the same as printf "%0*d").
+ * @param value The integer to add.
+ * @param width The minimum number of characters, sign included.
+ */
+void output_padded_int(int value, int width) {
+    char digits[16];
+    int length = 0, start = 0;
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+
+    /** Write the digits from the end of the array. */
+    do {
+        digits[sizeof(digits) - 1 - length++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude > 0);
+
+    if (value < 0) {
+        start = 1;
+    }
+    while (length + start < width && length < (int)sizeof(digits) - 1) {
+        digits[sizeof(digits) - 1 - length++] = '0';
+    }
+    if (value < 0) {
+        digits[sizeof(digits) - 1 - length++] = '-';
+    }
+
+    output_bytes(digits + sizeof(digits) - length, length);
+}
+
+/**
+ * Adds an integer to the output buffer.
+ * @param value The integer to add.
+ */
+void output_int(int value) {
+    output_padded_int(value, 0);
+}
+
+/**
+ * Adds a date to the output buffer in the format dd-mm-yyyy.
+ * @param day The day of the date.
+ * @param month The month of the date.
+ * @param year The year of the date.
+ */
+void output_date(int day, int month, int year) {
+    output_padded_int(day, 2);
+    output_char('-');
+    output_padded_int(month, 2);
+    output_char('-');
+    output_padded_int(year, 4);
+}
+
+/**
+ * Adds a time to the output buffer in the format hh:mm.
+ * @param hour The hour of the time.
+ * @param minutes The minutes of the time.
+ */
+void output_time(int hour, int minutes) {
+    output_padded_int(hour, 2);
+    output_char(':');
+    output_padded_int(minutes, 2);
+}
+
+/**
+ * Adds an amount of money to the output buffer in units, with two
+ * decimal places.
+ * @param cents The amount in cents.
+ */
+void output_money(int64_t cents) {
+    char digits[MAX_MONEY_LENGTH];
+    uint64_t value = cents < 0 ? -(uint64_t)cents : (uint64_t)cents;
+    int length = 0;
+
+    /** Write the cents, the point and the units from the end of the array. */
+    digits[sizeof(digits) - 1 - length++] = '0' + value % 10;
+    digits[sizeof(digits) - 1 - length++] = '0' + value / 10 % 10;
+    digits[sizeof(digits) - 1 - length++] = '.';
+    value /= 100;
+    do {
+        digits[sizeof(digits) - 1 - length++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+    if (cents < 0) {
+        digits[sizeof(digits) - 1 - length++] = '-';
+    }
+
+    output_bytes(digits + sizeof(digits) - length, length);
+}
+
@@ -0,0 +1,47 @@
+/**
+ * File with the buffered output writer.
+ * @file output.h
+ * @author ist1106369 Sophia Alencar
+*/
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/** Size of the output buffer, written to stdout when full. */
+#define OUTPUT_BLOCK_SIZE (1 << 16)
+
+/** Size of any money value, with the sign, the 20 digits of the
+ * largest 64 bit value and the point. */
+#define MAX_MONEY_LENGTH 22
+
+/** Initial capacity of a buffer capturing output. */
+#define INITIAL_CAPTURE_SIZE 256
+
+/** Structs. */
+
+typedef struct {
+    char *bytes;            /**< Bytes captured. */
+    size_t length;          /**< Number of bytes captured. */
+    size_t capacity;        /**< Capacity of the bytes array. */
+} output_buffer;
+
+
+/** Writer functions. */
+void output_bytes(const char *bytes, size_t length);
+void output_string(const char *string);
+void output_char(char character);
+void output_int(int value);
+void output_padded_int(int value, int width);
+void output_date(int day, int month, int year);
+void output_time(int hour, int minutes);
+void output_money(int64_t cents);
+void flush_output(void);
+void capture_output(output_buffer *buffer);
+void set_output_barrier(void (*barrier)(void *context), void *context);
+
+#endif // OUTPUT_H
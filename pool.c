@@ -0,0 +1,75 @@
+/**
+ * File with the slab pool allocator.
+ * @file pool.c
+ * @author ist1106369 Sophia Alencar
+*/
+
+#include "pool.h"
+
+/**
+ * Initializes an empty pool, no memory is allocated until the first object.
+ * @param my_pool Pointer to the pool to initialize.
+ * @param object_size Size of the objects of the pool.
+ * @param alloc_type Structure of the objects, for the allocation stats.
+ */
+void initialize_pool(pool *my_pool, size_t object_size, int alloc_type) {
+    /** Round the size so every object stays aligned. */
+    my_pool->object_size = (object_size + POOL_ALIGNMENT - 1) / POOL_ALIGNMENT *
+        POOL_ALIGNMENT;
+    my_pool->slab_objects = FIRST_SLAB_OBJECTS;
+    my_pool->slabs = NULL;
+    my_pool->next_object = NULL;
+    my_pool->slab_end = NULL;
+    my_pool->alloc_type = alloc_type;
+}
+
+/**
+ * Gets a new object from a pool, allocating a new slab when the last one is full.
+ * @param my_pool Pointer to the pool.
+ * @return Pointer to the object, or NULL if the slab could not be allocated.
+ */
+void *pool_alloc(pool *my_pool) {
+    pool_slab *new_slab;
+    void *object;
+
+    if (my_pool->next_object == my_pool->slab_end) {
+        /** The objects start after the slab header. */
+        if ((new_slab = (pool_slab *)tracked_malloc(sizeof(pool_slab) +
+            my_pool->object_size * my_pool->slab_objects, my_pool->alloc_type)) == NULL) {
+            return NULL;
+        }
+        new_slab->next = my_pool->slabs;
+        new_slab->num_objects = my_pool->slab_objects;
+        my_pool->slabs = new_slab;
+        my_pool->next_object = (char *)(new_slab + 1);
+        my_pool->slab_end = my_pool->next_object +
+            my_pool->object_size * my_pool->slab_objects;
+
+        /** Each slab doubles the previous one, up to the max size. */
+        if (my_pool->slab_objects < MAX_SLAB_OBJECTS) {
+            my_pool->slab_objects *= 2;
+        }
+    }
+
+    object = my_pool->next_object;
+    my_pool->next_object += my_pool->object_size;
+    track_object(my_pool->alloc_type);
+    return object;
+}
+
+/**
+ * Frees all the objects of a pool at once, leaving it empty.
+ * @param my_pool Pointer to the pool.
+ */
+void free_pool(pool *my_pool) {
+    pool_slab *temp;
+
+    while (my_pool->slabs != NULL) {
+        temp = my_pool->slabs;
+        my_pool->slabs = temp->next;
+        tracked_free(temp, sizeof(pool_slab) + my_pool->object_size * temp->num_objects,
+            my_pool->alloc_type);
+    }
+
+    initialize_pool(my_pool, my_pool->object_size, my_pool->alloc_type);
+}
@@ -0,0 +1,46 @@
+/**
+ * File with the slab pool allocator.
+ * @file pool.h
+ * @author ist1106369 Sophia Alencar
+*/
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "stats.h"
+
+/** Number of objects in the first slab of a pool. */
+#define FIRST_SLAB_OBJECTS 16
+
+/** Max number of objects in a slab (each slab doubles the previous one). */
+#define MAX_SLAB_OBJECTS 4096
+
+/** Alignment of the objects of a pool. */
+#define POOL_ALIGNMENT sizeof(double)
+
+/** Structs. */
+
+typedef struct pool_slab {
+    struct pool_slab *next;     /**< Pointer to the slab allocated before. */
+    size_t num_objects;         /**< Number of objects in the slab. */
+} pool_slab;
+
+typedef struct {
+    size_t object_size;         /**< Size of each object, aligned. */
+    size_t slab_objects;        /**< Number of objects of the next slab. */
+    pool_slab *slabs;           /**< Pointer to the last slab allocated. */
+    char *next_object;          /**< Next object never given in the last slab. */
+    char *slab_end;             /**< End of the last slab. */
+    int alloc_type;             /**< Structure of the objects, for the allocation stats. */
+} pool;
+
+
+/** Pool functions. */
+void initialize_pool(pool *my_pool, size_t object_size, int alloc_type);
+void *pool_alloc(pool *my_pool);
+void free_pool(pool *my_pool);
+
+#endif // POOL_H
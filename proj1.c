@@ -5,103 +5,161 @@
 
 #include "proj1.h"
 #include "aux.h"
+#include "checkpoint.h"
+#include "shard.h"
+#include "wal.h"
 
 /** 
- * Lists all parkings in the parking array.
+ * Lists all parkings in the order they were created.
  * @param parking_args Pointer to the args structure 
  * containing parking information.
  */
 void list_all_parkings(args *parking_args) {
     int i;
-    for (i = 0; i < MAX_PARKINGS; i++) {
-        if (parking_args->parkings[i] != NULL) {
-            printf("%s %d %d\n", parking_args->parkings[i]->name, 
-                parking_args->parkings[i]->max_capacity, 
-                parking_args->parkings[i]->free_spaces);
+    parking *current_parking;
+
+    /** The ids are given in order, the removed ones are NULL. */
+    for (i = 0; i < parking_args->registry.num_ids; i++) {
+        current_parking = parking_args->registry.parkings[i];
+        if (current_parking != NULL) {
+            output_string(current_parking->name);
+            output_char(' ');
+            output_int(current_parking->max_capacity);
+            output_char(' ');
+            output_int(current_parking->free_spaces);
+            output_char('\n');
         }
     }
 }
 
 /** 
- * Adds a new parking to the parking array.
+ * Parses the costs of a tariff in cents. They must be positive and in
+ * order as written, which is checked before they are rounded to cents,
+ * otherwise they are all -1 so they are not valid.
+ * @param input_x Cost for the first 15 minutes periods in the first hour.
+ * @param input_y Cost for the first 15 minutes periods after the first hour.
+ * @param input_z mas cost for a whole day.
+ * @param cost_x Pointer to the cost x in cents.
+ * @param cost_y Pointer to the cost y in cents.
+ * @param cost_z Pointer to the cost z in cents.
+ */
+static void parse_costs(char *input_x, char *input_y, char *input_z,
+    money *cost_x, money *cost_y, money *cost_z) {
+    double x = atof(input_x), y = atof(input_y), z = atof(input_z);
+
+    if (x <= 0 || y <= 0 || z <= 0 || x >= y || x >= z || y >= z) {
+        *cost_x = *cost_y = *cost_z = -1;
+        return;
+    }
+    *cost_x = parse_money(input_x);
+    *cost_y = parse_money(input_y);
+    *cost_z = parse_money(input_z);
+}
+
+/** 
+ * Checks if the costs of a tariff are valid, printing an error if not.
+ * Rounding them to cents keeps their order but may make them equal,
+ * or make them 0, which is not valid: each cost is at least 1 cent.
+ * @param cost_x Cost for the first 15 minutes periods in the first hour, in cents.
+ * @param cost_y Cost for the first 15 minutes periods after the first hour, in cents.
+ * @param cost_z mas cost for a whole day, in cents.
+ * @return 1 if they are valid, otherwise 0.
+ */
+static int are_costs_valid(money cost_x, money cost_y, money cost_z) {
+    if (cost_x <= 0 || cost_z > MAX_COST || cost_x > cost_y || cost_y > cost_z) {
+        output_string("invalid cost.\n");
+        count_error(ERROR_INVALID_COST);
+        return 0;
+    }
+    return 1;
+}
+
+/** 
+ * Adds a new parking to the parking registry.
  * @param parking_args Pointer to the args structure 
  * containing parking information.
  * @param name Name of the new parking.
  * @param max_capacity Maximum capacity of the new parking.
- * @param cost_x Cost for the first 15 minutes periods in the first hour
- * @param cost_y Cost for the first 15 minutes periods after the first hour
- * @param cost_z mas cost for a whole day.
- * @return Returns 0 on success, -1 if parking limit is reached or other errors occur.
+ * @param cost_x Cost for the first 15 minutes periods in the first hour, in cents.
+ * @param cost_y Cost for the first 15 minutes periods after the first hour, in cents.
+ * @param cost_z mas cost for a whole day, in cents.
+ * @return Returns 0 on success, 1 if it already exists, -1 if other errors occur.
  */
-int add_new_parking(args *parking_args, char *name, int max_capacity, double cost_x, double cost_y, double cost_z) {
+int add_new_parking(args *parking_args, char *name, int max_capacity, money cost_x, money cost_y, money cost_z) {
 
-    int i;
     parking *new_parking; 
-    /** Check if parking limit has been reached. */
-    if (parking_args->park_counter >= MAX_PARKINGS) {
-        printf("too many parks.\n");
-        return -1;
-    }
 
     /** Check if a parking with the same name already exists. */
-    for (i = 0; i < MAX_PARKINGS; i++) {
-        if (parking_args->parkings[i] != NULL && 
-            strcmp(parking_args->parkings[i]->name, name) == 0) {
-            return 1;
-        }
+    if (find_parking(parking_args, name) != NULL) {
+        return 1;
     }
 
     /** Check if maximum capacity and costs are valid. */
     if (max_capacity <= 0 ) {
-        printf("%d: invalid capacity.\n", max_capacity);
-        return -1;
-    } else if (cost_x <= 0 || cost_y <= 0 || cost_z <= 0) {
-        printf("invalid cost.\n");
+        output_int(max_capacity);
+        output_string(": invalid capacity.\n");
+        count_error(ERROR_INVALID_CAPACITY);
         return -1;
-    } else if (cost_x >= cost_y || cost_x >= cost_z || cost_y >= cost_z) {
-        printf("invalid cost.\n");
+    } else if (!are_costs_valid(cost_x, cost_y, cost_z)) {
         return -1;
     }
 
     /** Allocate memory for the new parking. */
-    if ((new_parking = (parking *)malloc(sizeof(parking)) )== NULL) {
-        printf("Memory allocation of new parking failed.\n");
+    if ((new_parking = (parking *)tracked_malloc(sizeof(parking), ALLOC_PARKING) )== NULL) {
+        output_string("Memory allocation of new parking failed.\n");
         return -1;
     }
 
     /** Initialize new parking details. */
-    if ((new_parking->name = (char *)malloc(strlen(name) + 1) )== NULL) {
-        printf("Memory allocation of parking name failed.\n");
+    if ((new_parking->name = (char *)tracked_malloc(strlen(name) + 1, ALLOC_STRING) )== NULL) {
+        output_string("Memory allocation of parking name failed.\n");
         return -1;
     }
     strcpy(new_parking->name, name);
     new_parking->max_capacity = max_capacity;
-    new_parking->cost_x = cost_x;
-    new_parking->cost_y = cost_y;
-    new_parking->cost_z = cost_z;
-    new_parking->free_spaces = max_capacity;
-    new_parking->billing_day_log = NULL;
-    new_parking->last_billing_day_log = NULL;
 
-    /** Add the new parking to the parking array. */
-    parking_args->parkings[parking_args->park_counter] = new_parking;
-    parking_args->park_counter++;
+    /** The tariff of the creation is in effect from the first date. */
+    if ((new_parking->tariffs = create_tariff(0, cost_x, cost_y, cost_z)) == NULL) {
+        output_string("Memory allocation of parking tariff failed.\n");
+        return -1;
+    }
+    new_parking->free_spaces = max_capacity;
+    new_parking->billing_days = NULL;
+    new_parking->num_billing_days = 0;
+    new_parking->billing_capacity = 0;
+    new_parking->histories = NULL;
+    new_parking->removed_version = NO_VERSION;
+    new_parking->unlinked_version = NO_VERSION;
+    new_parking->next_removed = NULL;
+    new_parking->shared = parking_args->vehicles->shared;
+    new_parking->replaced = NULL;
+    initialize_pool(&new_parking->log_pool, sizeof(vehicle_log), ALLOC_VEHICLE_LOG);
+    initialize_pool(&new_parking->history_pool, sizeof(parking_history), ALLOC_HISTORY);
+
+    /** Add the new parking to the parking registry. */
+    if (add_parking_to_list(parking_args, new_parking) != 0) {
+        tracked_free(new_parking->tariffs, sizeof(tariff), ALLOC_PARKING);
+        tracked_free(new_parking->name, strlen(new_parking->name) + 1, ALLOC_STRING);
+        tracked_free(new_parking, sizeof(parking), ALLOC_PARKING);
+        return -1;
+    }
 
     return 0; 
 }
 
 /** 
- * Parses the buffer and either lists all parkings or adds a new parking.
+ * Either lists all parkings or adds a new parking.
  * @param parking_args Pointer to the args structure containing parking information.
- * @param buffer Input buffer containing command and parameters.
+ * @param line Command line containing the name and parameters.
  */
-void list_or_add_park(args *parking_args, char *buffer) {
+void list_or_add_park(args *parking_args, command_line *line) {
     char *token;
     char *name;
-    double cost_x, cost_y, cost_z;
+    money cost_x, cost_y, cost_z;
+    int result;
 
-    /** Parse the name from the buffer. */
-    name = parse_name(buffer);
+    /** Get the name from the command line. */
+    name = line->name;
 
     /** If no name is provided, list all parkings. */
     if (name == NULL) {
@@ -109,35 +167,28 @@ void list_or_add_park(args *parking_args, char *buffer) {
         return; 
     }
 
-    /** Tokenize the buffer to get max_capacity, 
+    /** Get the tokens of max_capacity, 
      * cost_x, cost_y, and cost_z. */
-    token = strtok(NULL, DELIMITER);
+    token = get_token(line, 0);
     if (token == NULL) {
         return;
     }
     int max_capacity = atoi(token);
 
-    token = strtok(NULL, DELIMITER);
-    if (token == NULL) {
-        return;
-    }
-    cost_x = atof(token);
-
-    token = strtok(NULL, DELIMITER);
-    if (token == NULL) {
-        return;
-    }
-    cost_y = atof(token);
-
-    token = strtok(NULL, DELIMITER);
-    if (token == NULL) {
+    if (get_token(line, 3) == NULL) {
         return;
     }
-    cost_z = atof(token);
+    parse_costs(get_token(line, 1), get_token(line, 2), get_token(line, 3),
+        &cost_x, &cost_y, &cost_z);
 
     /** Add the new parking unless it already exists. */
-    if (add_new_parking(parking_args, name, max_capacity, cost_x, cost_y, cost_z) == 1) {
-        printf("%s: parking already exists.\n", name);
+    result = add_new_parking(parking_args, name, max_capacity, cost_x, cost_y, cost_z);
+    if (result == 1) {
+        output_string(name);
+        output_string(": parking already exists.\n");
+        count_error(ERROR_PARKING_EXISTS);
+    } else if (result == 0) {
+        log_change(parking_args, 'p', find_parking(parking_args, name), EMPTY_KEY, NO_DATE);
     }
 }
 
@@ -145,347 +196,352 @@ void list_or_add_park(args *parking_args, char *buffer) {
 /** 
  * Registers a vehicle entry into the parking system.
  * @param parking_args Pointer to the args structure containing parking information.
- * @param buffer Input buffer containing command and parameters.
+ * @param line Command line containing the name and parameters.
  */
-void register_entry(args *parking_args, char *buffer) {
+void register_entry(args *parking_args, command_line *line) {
     char *name, *license_plate, *date_input, *time_input;
-    date *entry_date;
+    plate key;
+    date entry_date;
+    int date_parsed;
     parking *current_parking;
     vehicle *my_vehicle;
+    parking_task task;
 
-    /** Parse the name from the buffer */
-    name = parse_name(buffer);
+    /** Get the name from the command line */
+    name = line->name;
 
-    /** Parse license plate, date, and time from the buffer */
-    license_plate = strtok(NULL, DELIMITER);
-    date_input = strtok(NULL, DELIMITER);
-    time_input = strtok(NULL, DELIMITER);
+    /** Get license plate, date, and time from the command line */
+    license_plate = get_token(line, 0);
+    date_input = get_token(line, 1);
+    time_input = get_token(line, 2);
 
     /** Find the parking corresponding to the provided name */
     current_parking = find_parking(parking_args, name);
 
     /** Parse entry date */
-    entry_date = parse_date(date_input, time_input);
+    date_parsed = parse_date(date_input, time_input, &entry_date);
 
     /** Check if parking exists */
     if (current_parking == NULL) {
-        printf("%s: no such parking.\n", name);
-        free(entry_date);
+        output_string(name);
+        output_string(": no such parking.\n");
+        count_error(ERROR_NO_SUCH_PARKING);
         return;
     }
 
     /** Check if parking is full */
     if (current_parking->free_spaces <= 0) {
-        printf("%s: parking is full.\n", name);
-        free(entry_date);
+        output_string(name);
+        output_string(": parking is full.\n");
+        count_error(ERROR_PARKING_FULL);
         return;
     }
 
     /** Check if license plate is valid */
     if (license_plate == NULL || !is_license_plate_valid(license_plate)) {
-        printf("%s: invalid licence plate.\n", license_plate);
-        free(entry_date);
+        output_string(license_plate);
+        output_string(": invalid licence plate.\n");
+        count_error(ERROR_INVALID_PLATE);
         return;
     }
 
     /** Find the vehicle by license plate */
-    my_vehicle = find_vehicle(parking_args->vehicles, license_plate);
+    key = pack_license_plate(license_plate);
+    my_vehicle = find_vehicle(parking_args->vehicles, key);
 
     /** Check if vehicle is already parked */
     if (is_vehicle_parked(my_vehicle)) {
-        printf("%s: invalid vehicle entry.\n", license_plate);
-        free(entry_date);
+        output_string(license_plate);
+        output_string(": invalid vehicle entry.\n");
+        count_error(ERROR_INVALID_ENTRY);
         return;
     }
 
     /** Check if date and time are provided */
     if (date_input == NULL || time_input == NULL) {
-        printf("invalid date.\n");
-        free(entry_date);
+        output_string("invalid date.\n");
+        count_error(ERROR_INVALID_DATE);
         return;
     }
 
     /** Validate entry date */
-    if (!is_date_valid(entry_date, parking_args)) {
-        printf("invalid date.\n");
-        free(entry_date);
+    if (!date_parsed || !is_date_valid(&entry_date, parking_args)) {
+        output_string("invalid date.\n");
+        count_error(ERROR_INVALID_DATE);
         return;
     }
 
 
     /** If vehicle not found, create a new vehicle and a new entry */
-    if (my_vehicle == NULL) {
-        if ((my_vehicle = (vehicle *)malloc(sizeof(vehicle))) == NULL) {
-            printf("Memory allocation of new vehicle failed.\n");
-            return;
-        }
-        if ((my_vehicle->license_plate = (char *)malloc(strlen(license_plate) + 1)) == NULL) {
-            printf("%s :Memory allocation of license failed1.\n", license_plate);
-            return;
-        }
-
-        strcpy(my_vehicle->license_plate, license_plate);
-        my_vehicle->parking_name = NULL;
-        my_vehicle->is_parked = 0;
-        my_vehicle->my_logs = NULL;
-        my_vehicle->my_last_log = NULL;
-        insert_new_entry(parking_args->vehicles, license_plate, my_vehicle);
+    if (my_vehicle == NULL &&
+        (my_vehicle = add_new_vehicle(parking_args->vehicles, key)) == NULL) {
+        output_string("Memory allocation of new vehicle failed.\n");
+        return;
     }
 
-    /** Allocate memory for parking name */
-    if ((my_vehicle->parking_name = (char *)malloc(strlen(name) + 1)) == NULL) {
-        printf("Memory allocation of parking name failed.\n");
+    /** Find the history of the vehicle in the parking, adding it if needed. */
+    if ((task.history = find_parking_history(my_vehicle, current_parking)) == NULL) {
+        fprintf(stderr, "Memory allocation for new history failed\n");
         return;
     }
 
-    /** Set parking name in the vehicle entry */
-    strcpy(my_vehicle->parking_name, name);
-
+    /** The entry is accepted, log it before it is applied. */
+    log_change(parking_args, 'e', current_parking, key, parking_args->last_date);
 
     /** Update vehicle status and parking availability */
+    my_vehicle->parking_id = current_parking->id;
     my_vehicle->is_parked = 1;
+    my_vehicle->last_history = task.history;
     current_parking->free_spaces--;
 
-    /** Add entry log */
-    add_new_log(my_vehicle, current_parking, entry_date, name);
+    /** Add entry log, the entry date is now the last date. */
+    task.command = 'e';
+    task.my_parking = current_parking;
+    task.first_date = parking_args->last_date;
+    task.free_spaces = current_parking->free_spaces;
+    run_parking_task(parking_args, &task);
 }
 
 /** 
  * Registers the exit of a vehicle from the parking system.
  * @param parking_args Pointer to the args structure 
  * containing parking information.
- * @param buffer Input buffer containing command and parameters.
+ * @param line Command line containing the name and parameters.
  */
-void register_exit(args *parking_args, char *buffer) {
+void register_exit(args *parking_args, command_line *line) {
     char *name, *license_plate, *date_input, *time_input;
-    date *exit_date;
+    date exit_date;
+    int date_parsed;
     parking *current_parking;
     vehicle *my_vehicle;
-    vehicle_log *current_log;
-    double cost = 0.0;
+    parking_task task;
 
-    /** Parse name, license plate, date, and time from the buffer. */
-    name = parse_name(buffer);
-    license_plate = strtok(NULL, DELIMITER);
-    date_input = strtok(NULL, DELIMITER);
-    time_input = strtok(NULL, DELIMITER);
+    /** Get name, license plate, date, and time from the command line. */
+    name = line->name;
+    license_plate = get_token(line, 0);
+    date_input = get_token(line, 1);
+    time_input = get_token(line, 2);
 
     /** Parse exit date. */
-    exit_date = parse_date(date_input, time_input);
+    date_parsed = parse_date(date_input, time_input, &exit_date);
 
     /** Find the parking corresponding to the provided name. */
     current_parking = find_parking(parking_args, name);
 
-    /** Find the vehicle by license plate. */
-    my_vehicle = find_vehicle(parking_args->vehicles, license_plate);
-
-
     /** Validate parking and vehicle. */
     if (current_parking == NULL ) {
-        printf("%s: no such parking.\n", name);
-        free(exit_date);
+        output_string(name);
+        output_string(": no such parking.\n");
+        count_error(ERROR_NO_SUCH_PARKING);
         return;
     }
 
     /** Validate license plate. */
     if (license_plate == NULL || !is_license_plate_valid(license_plate)) {
-        printf("%s: invalid licence plate.\n", license_plate);
-        free(exit_date);
+        output_string(license_plate);
+        output_string(": invalid licence plate.\n");
+        count_error(ERROR_INVALID_PLATE);
         return;
     }
 
+    /** Find the vehicle by license plate. */
+    my_vehicle = find_vehicle(parking_args->vehicles, pack_license_plate(license_plate));
+
     /** Check if vehicle is parked in the specified parking. */
     if ( my_vehicle == NULL  || !is_vehicle_parked(my_vehicle) || 
-        strcmp(current_parking->name, my_vehicle->parking_name) != 0) {
-        printf("%s: invalid vehicle exit.\n", license_plate);
-        free(exit_date);
+        current_parking->id != my_vehicle->parking_id) {
+        output_string(license_plate);
+        output_string(": invalid vehicle exit.\n");
+        count_error(ERROR_INVALID_EXIT);
         return;
     }
 
 
     /** Validate date and time inputs. */
     if (date_input == NULL || time_input == NULL) {
-        free(exit_date);
         return;
     }
 
     /** Check if exit date is valid. */
-    if (!is_date_valid(exit_date, parking_args)) {
-        printf("invalid date.\n");
-        free(exit_date);
+    if (!date_parsed || !is_date_valid(&exit_date, parking_args)) {
+        output_string("invalid date.\n");
+        count_error(ERROR_INVALID_DATE);
         return;
     }
 
-    /** Get the last log entry for the vehicle. */
-    current_log = my_vehicle->my_last_log;
+    /** The exit is accepted, log it before it is applied. */
+    log_change(parking_args, 's', current_parking, my_vehicle->license_plate,
+        parking_args->last_date);
 
-    /** Update the exit date in the vehicle vehiclelog entry. */
-    current_log->exit_date = exit_date;
+    /** The vehicle entered this parking last, the exit closes that log. */
+    task.command = 's';
+    task.my_parking = current_parking;
+    task.history = my_vehicle->last_history;
+    task.first_date = parking_args->last_date;
 
     /** Update vehicle status. */
     my_vehicle->is_parked = 0;
-    free(my_vehicle->parking_name);
-    my_vehicle->parking_name = NULL;
+    my_vehicle->parking_id = NO_PARKING;
 
     /** Increase free spaces in the parking. */
     current_parking->free_spaces++;
 
+    run_parking_task(parking_args, &task);
+}
+
+/** 
+ * Closes the last log of a vehicle in a parking, charging it and 
+ * adding it to the billing day of the exit.
+ * @param history The history of the vehicle in the parking it leaves.
+ * @param exit_date The exit date of the vehicle.
+ * @param exit_version The version of the exit.
+ */
+static void close_vehicle_log(parking_history *history, timestamp exit_date,
+    version exit_version) {
+    parking *current_parking = history->my_parking;
+    vehicle_log *current_log = history->last_log;
+
+    /** Update the exit date in the vehicle log entry. */
+    current_log->exit_date = exit_date;
+
     /** Calculate cost. */
-    cost = calculate_cost(current_parking, current_log);
-    current_log->cost = cost;
+    current_log->cost = calculate_cost(current_parking, current_log);
+
+    /** Snapshots see the exit from now on, with its date and cost. */
+    __atomic_store_n(&current_log->exit_version, exit_version, __ATOMIC_RELEASE);
 
     /** Add exit log entry to the parking. */
-    add_new_exit(current_parking, exit_date, cost, my_vehicle);
+    add_new_exit(current_parking, current_log);
 
     /** Print the exit details. */
-    printf("%s %02d-%02d-%04d %02d:%02d %02d-%02d-%04d %02d:%02d %.2f\n", 
-        my_vehicle->license_plate, current_log->entry_date->day, 
-        current_log->entry_date->month, 
-        current_log->entry_date->year, current_log->entry_date->hour, 
-        current_log->entry_date->minutes, 
-        current_log->exit_date->day, current_log->exit_date->month, 
-        current_log->exit_date->year,
-        current_log->exit_date->hour, current_log->exit_date->minutes, cost);
+    output_license_plate(current_log->license_plate);
+    output_char(' ');
+    output_timestamp(current_log->entry_date);
+    output_char(' ');
+    output_timestamp(current_log->exit_date);
+    output_char(' ');
+    output_money(current_log->cost);
+    output_char('\n');
 }
 
 
 /** 
  * Lists all the log entries for a given vehicle from all parkings.
  * @param parking_args Pointer to the args structure containing parking information.
- * @param buffer Input buffer containing command and parameters.
+ * @param line Command line containing the license plate.
  */
-void list_vehicle_logs(args *parking_args, char *buffer) {
-    int i, entries_found = 0, num_parkings = 0;
-    char *license_plate, *parking_names[MAX_PARKINGS];;
-    vehicle *my_vehicle;
-    parking *current_parking; 
-    vehicle_log *current_log;
-
-    /** Initialize the current log to null. */
-    current_log = NULL;
+void list_vehicle_logs(args *parking_args, command_line *line) {
+    char *license_plate;
+    parking_task task;
 
-    /** Parse license plate from the buffer. */
-    license_plate = strtok(buffer, DELIMITER);
+    /** Get license plate from the command line. */
+    license_plate = get_token(line, 0);
 
     /** Validate license plate. */
     if (license_plate == NULL || !is_license_plate_valid(license_plate)) {
-        printf("%s: invalid licence plate.\n", license_plate);
+        output_string(license_plate);
+        output_string(": invalid licence plate.\n");
+        count_error(ERROR_INVALID_PLATE);
         return;
     }
 
-    /** Add all the parking names to an array to later sort. */
-    for (i = 0; i < parking_args->park_counter; i++) {
-        if (parking_args->parkings[i] != NULL) {
-            parking_names[num_parkings++] = parking_args->parkings[i]->name;
-        }
-    }
+    /** The logs are read from a snapshot, the vehicle is found there. */
+    task.command = 'v';
+    task.my_parking = NULL;
+    task.vehicles = parking_args->vehicles;
+    task.license_plate = pack_license_plate(license_plate);
+    run_parking_task(parking_args, &task);
+}
 
-    /** Sort parking names by alphabetical order. */
-    insertion_sort(parking_names, num_parkings);
-    
+/** 
+ * Displays all the log entries of a vehicle from all parkings, as they
+ * were before a command.
+ * @param vehicles Hashtable of the vehicles.
+ * @param license_plate License plate of the vehicle.
+ * @param snapshot Version of the command, NO_VERSION if nothing changes
+ * the logs meanwhile.
+ */
+void show_vehicle_logs(hashtable *vehicles, plate license_plate, version snapshot) {
+    int entries_found = 0;
+    vehicle *my_vehicle;
+    parking_history *current_history; 
+    vehicle_log *current_log;
+
+    /** Find vehicle by license plate, a newer one has no logs in the snapshot. */
+    my_vehicle = find_vehicle(vehicles, license_plate);
 
-    /** Find vehicle by license plate. */
-    my_vehicle = find_vehicle(parking_args->vehicles, license_plate);
-
-    /** Check if vehicle exists. */
-    if (my_vehicle == NULL) {
-        printf("%s: no entries found in any parking.\n", license_plate);
-        return;
-    }
-
-    /** Iterate through sorted parking array. */
-    for (i = 0; i < num_parkings; i++) {
-        current_parking = find_parking(parking_args, parking_names[i]);
-        current_log = my_vehicle->my_logs;
-
-        /** Iterate through the vehicle log entries. */
-        while (current_log != NULL) {
-            if (strcmp(current_log->parking_name, current_parking->name) == 0) {
-                entries_found = 1; 
-                printf("%s %02d-%02d-%04d %02d:%02d", current_log->parking_name, 
-                    current_log->entry_date->day, current_log->entry_date->month,
-                    current_log->entry_date->year, current_log->entry_date->hour,
-                    current_log->entry_date->minutes);
-                /** If there is an exit date print it, if not don´t. */       
-                if (current_log->exit_date != NULL) {
-                    printf(" %02d-%02d-%04d %02d:%02d\n", current_log->exit_date->day,
-                        current_log->exit_date->month, current_log->exit_date->year,
-                        current_log->exit_date->hour, current_log->exit_date->minutes);
-                } else {
-                    printf("\n");
-                }
+    /** Iterate through the histories of the vehicle, sorted by parking name. */
+    current_history = my_vehicle != NULL ?
+        __atomic_load_n(&my_vehicle->histories, __ATOMIC_ACQUIRE) : NULL;
+    for (; current_history != NULL;
+        current_history = __atomic_load_n(&current_history->next, __ATOMIC_ACQUIRE)) {
+
+        /** Skip the parkings removed but not yet reclaimed, and the newer histories. */
+        current_log = get_visible_log(&current_history->first_log, snapshot);
+        if (current_log == NULL || is_parking_removed(current_history->my_parking, snapshot)) {
+            continue;
+        }
+        entries_found = 1;
+
+        /** Iterate through the vehicle log entries in the parking. */
+        for (; current_log != NULL; current_log = get_visible_log(&current_log->next, snapshot)) {
+            output_string(current_history->my_parking->name);
+            output_char(' ');
+            output_timestamp(current_log->entry_date);
+            /** If there is an exit date print it, if not don´t. */       
+            if (is_exit_visible(current_log, snapshot)) {
+                output_char(' ');
+                output_timestamp(current_log->exit_date);
             }
-            /** Update current_log. */
-            current_log = current_log->next;
+            output_char('\n');
         }
     }
 
     /** Check if any log entries were found. */
     if (!entries_found) {
-        printf("%s: no entries found in any parking.\n", license_plate);
-        return;
+        output_license_plate(license_plate);
+        output_string(": no entries found in any parking.\n");
+        count_error(ERROR_NO_ENTRIES);
     }
 }
 
 
 /** 
  * Displays the daily revenue summary for a specific parking.
- * @param parking_args Pointer to the args structure containing
- *  parking information.
- * @param parking_name Name of the parking for which the daily 
- * revenue summary is to be displayed.
+ * @param my_parking The parking.
+ * @param snapshot Version of the command, NO_VERSION if nothing changes
+ * the billing days meanwhile.
  */
-void show_daily_summary( parking *my_parking) {
+void show_daily_summary(parking *my_parking, version snapshot) {
 
-    billing_day *current_day;
+    int i, num_days;
+    billing_day *days;
+
+    num_days = get_visible_days(my_parking, snapshot, &days);
 
-    /** Update current day with the first billing log of the park. */
-    current_day = my_parking->billing_day_log;
-    
     /** Iterate through each billing day and display the total revenue. */
-    while(current_day != NULL){
-        printf("%02d-%02d-%04d %.2f\n", current_day->exit_date->day, 
-            current_day->exit_date->month,
-            current_day->exit_date->year, current_day->total_cost);
-            current_day = current_day->next;
+    for (i = 0; i < num_days; i++) {
+        output_day(days[i].exit_date);
+        output_char(' ');
+        output_money(get_day_total(&days[i], i == num_days - 1, snapshot));
+        output_char('\n');
     }
 }
 
 /** 
  * Displays the revenue details for a specific parking on a given date.
- * @param parking_args Pointer to the args structure containing parking information.
- * @param parking_name Name of the parking for which the revenue details are to be displayed.
- * @param revenue_date Pointer to the date structure representing the revenue date.
+ * @param current_parking The parking for which the revenue details are to be displayed.
+ * @param revenue_date The revenue date, at 00:00.
+ * @param snapshot Version of the command, NO_VERSION if nothing changes
+ * the billing days meanwhile.
  */
-void show_day_revenue_list(args *parking_args, char *parking_name, date *revenue_date) {
+void show_day_revenue_list(parking *current_parking, timestamp revenue_date, version snapshot) {
 
-    parking *current_parking;
-    billing_day *current_day = NULL;
     billing_day *last_valid_date = NULL; 
     vehicle_log *current_vehicle_log;
 
-    /** Check if revenue_date is after last action. */
-    if (compare_dates(&parking_args->last_date, revenue_date) > 0){
-        printf("invalid date.\n");
-        return;
-    }
-    
-    /** Find the parking with the input name. */
-    current_parking = find_parking(parking_args, parking_name);
-
-    /** Update current day with the first billing log of the park. */
-    current_day = current_parking->billing_day_log;
-
     /** Find the billing day corresponding to the revenue date. */
-    while (current_day != NULL) {
-        /** Check if the dates are equal and update the valid date if they are. */
-        if (compare_dates(current_day->exit_date, revenue_date) == 0) {
-            last_valid_date = current_day;
-            break;
-        }
-
-        current_day = current_day->next;
-    }
+    last_valid_date = find_billing_day(current_parking, revenue_date, snapshot);
 
     /** Check if a valid billing day was found. */
     if (last_valid_date == NULL) {
@@ -495,11 +551,15 @@ void show_day_revenue_list(args *parking_args, char *parking_name, date *revenue
     current_vehicle_log = last_valid_date->vehicle_log; 
 
     /** Display revenue details for each vehicle log entry on the revenue date. */
-    while (current_vehicle_log != NULL) {
-        printf("%s %02d:%02d %.2f\n", current_vehicle_log->license_plate, 
-            current_vehicle_log->exit_date->hour,
-            current_vehicle_log->exit_date->minutes, current_vehicle_log->cost);
-            current_vehicle_log = current_vehicle_log->next;
+    while (current_vehicle_log != NULL && is_exit_visible(current_vehicle_log, snapshot)) {
+        output_license_plate(current_vehicle_log->license_plate);
+        output_char(' ');
+        output_hour(current_vehicle_log->exit_date);
+        output_char(' ');
+        output_money(current_vehicle_log->cost);
+        output_char('\n');
+        current_vehicle_log = __atomic_load_n(&current_vehicle_log->next_in_day,
+            __ATOMIC_ACQUIRE);
     }
 
 }
@@ -507,79 +567,442 @@ void show_day_revenue_list(args *parking_args, char *parking_name, date *revenue
 /** 
  * Displays the revenue summary for a parking either daily or on a specific date.
  * @param parking_args Pointer to the args structure containing parking information.
- * @param buffer Input buffer containing command and parameters.
+ * @param line Command line containing the name and parameters.
  */
-void show_revenue(args *parking_args, char *buffer) {
+void show_revenue(args *parking_args, command_line *line) {
     char *parking_name, *date_input;
-    date *revenue_date;
+    date revenue_date;
     parking *my_parking;
+    parking_task task;
+    long long revenue_minutes;
 
-    /** Initialize a revenue date. */
-    revenue_date = NULL;
-
-    /** Parse parking name from the buffer. */
-    parking_name = parse_name(buffer);
+    /** Get parking name from the command line. */
+    parking_name = line->name;
 
     my_parking = find_parking(parking_args, parking_name);
 
     if(my_parking == NULL){
-        printf("%s: no such parking.\n", parking_name);
+        output_string(parking_name);
+        output_string(": no such parking.\n");
+        count_error(ERROR_NO_SUCH_PARKING);
         return;
     }
 
-    /** Parse date input from the buffer. */
-    date_input = strtok(NULL, DELIMITER);
+    /** Get date input from the command line. */
+    date_input = get_token(line, 0);
+
+    task.command = 'f';
+    task.my_parking = my_parking;
 
     /** If date input is null, display daily summaries of the park. */
     if (date_input == NULL) {
-        show_daily_summary(my_parking);
+        task.first_date = NO_DATE;
+        run_parking_task(parking_args, &task);
         return;
     }
 
     /** Parse revenue date. */
-    revenue_date = parse_date(date_input, NULL);
+    if (!parse_date(date_input, NULL, &revenue_date)) {
+        output_string("invalid date.\n");
+        count_error(ERROR_INVALID_DATE);
+        return;
+    }
+
+    /** Check if revenue_date is after last action (its day starts 
+     * at 00:00, so the day of the last action is not after it). */
+    revenue_minutes = get_all_minutes(&revenue_date);
+    if (parking_args->last_date == NO_DATE || 
+        revenue_minutes > parking_args->last_date) {
+        output_string("invalid date.\n");
+        count_error(ERROR_INVALID_DATE);
+        return;
+    }
+
+    /** A date that does not exist has no billing day. */
+    if (!is_calendar_date(&revenue_date)) {
+        return;
+    }
 
     /** Display revenue details for the parking on the specified date. */
-    show_day_revenue_list(parking_args, parking_name, revenue_date);
-    free(revenue_date);
+    task.first_date = (timestamp)revenue_minutes;
+    run_parking_task(parking_args, &task);
+}
+
+/** 
+ * Checks if a revenue date is a real date not after the last action.
+ * @param parking_args Pointer to the args structure containing parking information.
+ * @param revenue_date Pointer to the date structure representing the revenue date.
+ * @return 1 if the date is valid, otherwise 0.
+ */
+static int is_revenue_date_valid(args *parking_args, date *revenue_date) {
+    return is_calendar_date(revenue_date) && parking_args->last_date != NO_DATE &&
+        get_all_minutes(revenue_date) <= parking_args->last_date;
+}
+
+/** 
+ * Displays the total revenue of a parking between two dates, both included.
+ * @param parking_args Pointer to the args structure containing parking information.
+ * @param line Command line containing the name and the two dates.
+ */
+void show_revenue_range(args *parking_args, command_line *line) {
+    char *parking_name, *first_input, *last_input;
+    date first_date, last_date;
+    parking *my_parking;
+    parking_task task;
 
+    /** Get parking name and dates from the command line. */
+    parking_name = line->name;
+    first_input = get_token(line, 0);
+    last_input = get_token(line, 1);
+
+    my_parking = find_parking(parking_args, parking_name);
+
+    if (my_parking == NULL) {
+        output_string(parking_name);
+        output_string(": no such parking.\n");
+        count_error(ERROR_NO_SUCH_PARKING);
+        return;
+    }
+
+    if (first_input == NULL || last_input == NULL) {
+        return;
+    }
+
+    /** Both dates must exist, be in order and not after the last action. */
+    if (!parse_date(first_input, NULL, &first_date) || 
+        !parse_date(last_input, NULL, &last_date) ||
+        !is_revenue_date_valid(parking_args, &first_date) ||
+        !is_revenue_date_valid(parking_args, &last_date) ||
+        get_all_minutes(&first_date) > get_all_minutes(&last_date)) {
+        output_string("invalid date.\n");
+        count_error(ERROR_INVALID_DATE);
+        return;
+    }
+
+    task.command = 't';
+    task.my_parking = my_parking;
+    task.first_date = (timestamp)get_all_minutes(&first_date);
+    task.last_date = (timestamp)get_all_minutes(&last_date);
+    run_parking_task(parking_args, &task);
 }
 
 /** 
  * Removes a parking from the parking list and all its associated vehicle logs.
  * @param parking_args Pointer to the args structure containing parking information.
- * @param buffer Input buffer containing command and parameters.
+ * @param line Command line containing the parking name.
  */
-void remove_parking(args *parking_args, char *buffer) {
-    char *parking_name,*parking_names[MAX_PARKINGS];
-    int i, num_parkings = 0;
+void remove_parking(args *parking_args, command_line *line) {
+    char *parking_name;
+    int i;
     parking *my_parking;
 
-    /** Parse parking name from the buffer. */
-    parking_name = parse_name(buffer);
+    /** Get parking name from the command line. */
+    parking_name = line->name;
 
     my_parking = find_parking(parking_args,parking_name);
 
     if (my_parking == NULL) {
-        printf("%s: no such parking.\n", parking_name);
+        output_string(parking_name);
+        output_string(": no such parking.\n");
+        count_error(ERROR_NO_SUCH_PARKING);
         return;
     }
     
-    /** Remove the parking from the parking list and its associated vehicle logs. */
-    remove_parking_from_logs(parking_args->vehicles, parking_name);
+    log_change(parking_args, 'r', my_parking, EMPTY_KEY, NO_DATE);
+
+    /** Remove the parking from the parking list, its associated vehicle 
+     * logs are reclaimed after the next commands. */
     remove_parking_from_list(parking_args, parking_name);
     
-    
-    /** Collect remaining parking names after removal for sorting. */
-    for (i = 0; i < parking_args->park_counter; i++) {
-        if (parking_args->parkings[i] != NULL) {
-            parking_names[num_parkings++] = parking_args->parkings[i]->name;
+    /** Display the remaining parking names, already sorted. */
+    for (i = 0; i < parking_args->registry.num_parkings; i++) {
+        output_string(parking_args->registry.sorted[i]->name);
+        output_char('\n');
+    }
+}
+
+/** 
+ * Adds a tariff to a parking, in effect from a given day or from the
+ * last date, which charges the exits from then on.
+ * @param parking_args Pointer to the args structure containing parking information.
+ * @param line Command line containing the parking name, the costs and
+ * optionally the day.
+ */
+void change_tariff(args *parking_args, command_line *line) {
+    char *parking_name, *date_input;
+    money cost_x, cost_y, cost_z;
+    date effective_date;
+    parking *my_parking;
+    parking_task task;
+
+    /** Get parking name from the command line. */
+    parking_name = line->name;
+    if (parking_name == NULL) {
+        return;
+    }
+
+    my_parking = find_parking(parking_args, parking_name);
+
+    if (my_parking == NULL) {
+        output_string(parking_name);
+        output_string(": no such parking.\n");
+        count_error(ERROR_NO_SUCH_PARKING);
+        return;
+    }
+
+    /** Get the tokens of cost_x, cost_y, cost_z and the optional day. */
+    if (get_token(line, 2) == NULL) {
+        return;
+    }
+    parse_costs(get_token(line, 0), get_token(line, 1), get_token(line, 2),
+        &cost_x, &cost_y, &cost_z);
+    date_input = get_token(line, 3);
+
+    if (!are_costs_valid(cost_x, cost_y, cost_z)) {
+        return;
+    }
+
+    /** The day may be before the last date, for the stays priced again. */
+    if (date_input == NULL) {
+        task.first_date = parking_args->last_date != NO_DATE ? parking_args->last_date : 0;
+    } else if (parse_date(date_input, NULL, &effective_date) &&
+        is_calendar_date(&effective_date)) {
+        task.first_date = (timestamp)get_all_minutes(&effective_date);
+    } else {
+        output_string("invalid date.\n");
+        count_error(ERROR_INVALID_DATE);
+        return;
+    }
+
+    if ((task.new_tariff = create_tariff(task.first_date, cost_x, cost_y, cost_z)) == NULL) {
+        output_string("Memory allocation of parking tariff failed.\n");
+        return;
+    }
+    log_tariff(parking_args, my_parking, task.new_tariff);
+
+    /** The worker of the parking adds it, after the exits before it. */
+    task.command = 'c';
+    task.my_parking = my_parking;
+    run_parking_task(parking_args, &task);
+}
+
+/** 
+ * Prices again the stays of all the parkings that exit between two days,
+ * with the tariffs in effect at their exits, each parking on its worker,
+ * and waits for all of them.
+ * @param parking_args Pointer to the args structure containing parking information.
+ * @param line Command line containing the two days.
+ */
+void reprice_stays(args *parking_args, command_line *line) {
+    char *first_input, *last_input;
+    date first_date, last_date;
+    parking_task task;
+    int i;
+
+    /** Get the days from the command line. */
+    first_input = get_token(line, 0);
+    last_input = get_token(line, 1);
+    if (first_input == NULL || last_input == NULL) {
+        return;
+    }
+
+    /** Both days must exist, be in order and not after the last action. */
+    if (!parse_date(first_input, NULL, &first_date) || 
+        !parse_date(last_input, NULL, &last_date) ||
+        !is_revenue_date_valid(parking_args, &first_date) ||
+        !is_revenue_date_valid(parking_args, &last_date) ||
+        get_all_minutes(&first_date) > get_all_minutes(&last_date)) {
+        output_string("invalid date.\n");
+        count_error(ERROR_INVALID_DATE);
+        return;
+    }
+
+    task.command = 'R';
+    task.first_date = (timestamp)get_all_minutes(&first_date);
+    task.last_date = (timestamp)get_all_minutes(&last_date);
+    log_repricing(parking_args, task.first_date, task.last_date);
+
+    /** One task for each parking, sorted by name, with its own output. */
+    for (i = 0; i < parking_args->registry.num_parkings; i++) {
+        task.my_parking = parking_args->registry.sorted[i];
+        if (parking_args->engine != NULL) {
+            split_sharded_output(parking_args->engine);
         }
+        run_parking_task(parking_args, &task);
+    }
+
+    /** The tasks of a worker share the version, so the reports after it
+     * could not wait for the last one: wait for all of them here. */
+    if (parking_args->engine != NULL) {
+        split_sharded_output(parking_args->engine);
+        wait_shard_workers(parking_args->engine);
+    }
+}
+
+/** 
+ * Prices again the stays of a parking that exit between two days, and
+ * displays its revenue between them before and after.
+ * @param my_parking The parking.
+ * @param first_date The first day, at 00:00.
+ * @param last_date The last day, at 00:00.
+ */
+void show_repricing(parking *my_parking, timestamp first_date, timestamp last_date) {
+    money revenue = get_revenue_between(my_parking, first_date, last_date);
+
+    reprice_parking(my_parking, first_date, last_date);
+
+    output_string(my_parking->name);
+    output_char(' ');
+    output_money(revenue);
+    output_char(' ');
+    output_money(get_revenue_between(my_parking, first_date, last_date));
+    output_char('\n');
+}
+
+/** 
+ * Executes the part of a command that only reads and changes its parking,
+ * or that only reads the logs.
+ * @param task The part of the command.
+ * @param snapshot Version to read v and f from, NO_VERSION if nothing
+ * changes the logs meanwhile.
+ */
+void execute_parking_task(parking_task *task, version snapshot) {
+    switch (task->command) {
+
+        case 'e':
+            add_new_log(task->history, task->first_date, task->free_spaces,
+                task->command_version);
+            break;
+
+        case 's':
+            close_vehicle_log(task->history, task->first_date, task->command_version);
+            break;
+
+        case 'v':
+            show_vehicle_logs(task->vehicles, task->license_plate, snapshot);
+            break;
+
+        case 'f':
+            if (task->first_date == NO_DATE) {
+                show_daily_summary(task->my_parking, snapshot);
+            } else {
+                show_day_revenue_list(task->my_parking, task->first_date, snapshot);
+            }
+            break;
+
+        case 't':
+            output_money(get_revenue_between(task->my_parking, task->first_date,
+                task->last_date));
+            output_char('\n');
+            break;
+
+        case 'c':
+            insert_tariff(task->my_parking, task->new_tariff);
+            break;
+
+        case 'R':
+            show_repricing(task->my_parking, task->first_date, task->last_date);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/** 
+ * Runs the part of a command that only reads and changes its parking,
+ * right away or on the worker that owns the parking, or that only
+ * reads the logs, right away or on a reporting thread.
+ * @param parking_args Pointer to the args structure containing parking information.
+ * @param task The part of the command, copied if it runs later.
+ */
+void run_parking_task(args *parking_args, parking_task *task) {
+    task->command_version = parking_args->command_version;
+    if (parking_args->engine == NULL || !route_parking_task(parking_args->engine, task)) {
+        execute_parking_task(task, NO_VERSION);
+    }
+}
+
+/** 
+ * Executes a command, calling the function of its command character,
+ * and then reclaims a bounded part of the removed parkings.
+ * With the statistics enabled, its latency and errors are recorded.
+ * With the workers started, the output stays in the order of the commands.
+ * @param parking_args Pointer to the args structure containing parking information.
+ * @param line Command line to execute.
+ */
+void execute_command(args *parking_args, command_line *line) {
+    uint64_t start = 0;
+
+    if (stats_enabled) {
+        start = stats_clock();
+        start_command_stats(line->command);
+    }
+    parking_args->command_version++;
+    if (parking_args->engine != NULL) {
+        begin_sharded_command(parking_args->engine, line->command);
+    }
+
+    switch (line->command) {
+
+        case 'p':
+            list_or_add_park(parking_args, line);
+            break;
+
+        case 'e':
+            register_entry(parking_args, line);
+            break;
+
+        case 's':
+            register_exit(parking_args, line);
+            break;
+
+        case 'v':
+            list_vehicle_logs(parking_args, line);
+            break;
+
+        case 'f':
+            show_revenue(parking_args, line);
+            break;
+
+        case 't':
+            show_revenue_range(parking_args, line);
+            break;
+
+        case 'r':
+            remove_parking(parking_args, line);
+            break;
+
+        case 'c':
+            change_tariff(parking_args, line);
+            break;
+
+        case 'R':
+            reprice_stays(parking_args, line);
+            break;
+
+        case 'W':
+            save_checkpoint(parking_args, line);
+            break;
+
+        case 'S':
+            /** Statistics so far, after the output of the previous commands. */
+            if (stats_enabled) {
+                flush_output();
+                print_stats(stdout);
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    if (parking_args->engine != NULL) {
+        end_sharded_command(parking_args->engine);
     }
+    reclaim_removed_parkings(parking_args, RECLAIM_STEP);
 
-    /** Sort and display remaining parking names array for output. */
-    insertion_sort(parking_names, num_parkings);
-    for (i = 0; i < num_parkings; i++) {
-        printf("%s\n", parking_names[i]);
+    if (stats_enabled) {
+        end_command_stats(start);
     }
 }
@@ -9,17 +9,58 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "input.h"
+#include "output.h"
+#include "pool.h"
+#include "stats.h"
 
 /** Constants **/
 
-/** Number os max parkings that can exist at the same time. */
-#define MAX_PARKINGS 20
+/** Initial capacity of the parking registry. */
+#define INITIAL_PARKINGS 32
+
+/** Initial capacity of the billing days array of a parking. */
+#define INITIAL_BILLING_DAYS 8
+
+/** Initial length of the parking name index (must be a power of 2). */
+#define INITIAL_NAME_INDEX 64
+
+/** Markers of the name index slots without a parking id. */
+#define EMPTY_SLOT -1
+#define REMOVED_SLOT -2
+
+/** Max number of vehicle histories of removed parkings reclaimed after each command. */
+#define RECLAIM_STEP 64
+
+/** Id of no parking. */
+#define NO_PARKING -1
+
+/** Initial length of the hastable (must be a power of 2). */
+#define INITIAL_LENGTH 2048
+
+/** Max load of the hashtable (3/4) before it starts growing. */
+#define MAX_LOAD_NUMERATOR 3
+#define MAX_LOAD_DENOMINATOR 4
+
+/** Number of slots moved to the grown hashtable on each insertion. */
+#define MIGRATION_STEP 4
+
+/** Key of the empty hashtable entries (packed plates have no '\0'). */
+#define EMPTY_KEY 0
 
-/** Delimeter for parsing purposes. */
-#define DELIMITER " \t\n"
+/** Size of a license plate, including the '\0'. */
+#define LICENSE_PLATE_SIZE 9
 
-/** Initial length of the hastable. */
-#define INITIAL_LENGTH 2024
+/** Positions of the dashes in a license plate, as a bit mask. */
+#define DASHES_MASK 0x24
+
+/** Positions of the three pairs of a license plate, as bit masks. */
+#define FIRST_PAIR_MASK 0x03
+#define SECOND_PAIR_MASK 0x18
+#define THIRD_PAIR_MASK 0xC0
 
 /** Number of days in months. */
 #define MONTH_31 31
@@ -40,9 +81,53 @@
 #define NOVEMBER 11
 #define DECEMBER 12
 
+/** Number of days in a year (the calendar has no leap years). */
+#define DAYS_IN_YEAR 365
+
+/** Number of minutes in a day. */
+#define MINUTES_IN_DAY (24 * 60)
+
+/** Stays are charged by periods of 15 minutes, the ones of the first
+ * hour of each day at cost_x and the others at cost_y. */
+#define MINUTES_IN_PERIOD 15
+#define PERIODS_IN_FIRST_HOUR 4
+#define PERIODS_IN_DAY (MINUTES_IN_DAY / MINUTES_IN_PERIOD)
+
+/** Largest cost of a tariff, in cents, so the costs of the stays of
+ * thousands of years and their sums still fit in 64 bits. */
+#define MAX_COST 100000000000LL
+
+/** Number of stays priced together by calculate_costs. */
+#define PRICING_BLOCK 256
+
+/** Largest year of a valid date, so its timestamp fits in 32 bits. */
+#define MAX_YEAR 8000
+
+/** Timestamp of no date (the last date before any command or
+ * the exit date of a vehicle still parked). */
+#define NO_DATE UINT32_MAX
+
+/** Version after all the others (of a change not made, or of a read
+ * that sees every change). */
+#define NO_VERSION UINT64_MAX
+
 /** Structs. */
 
+/** License plate with its 8 characters packed in a single word. */
+typedef uint64_t plate;
 
+/** Date as a number of minutes: (year * 365 + day of the year) * 1440
+ * + minutes of the day, so dates compare and subtract as integers. */
+typedef uint32_t timestamp;
+
+/** Amount of money in cents, so it is exact and adds up the same in any order. */
+typedef int64_t money;
+
+/** Number of a command in the input: the changes of a command have its
+ * version, and a read from a snapshot only sees older versions. */
+typedef uint64_t version;
+
+/** Date split in its fields, only used to parse and print timestamps. */
 typedef struct date {
 
     int day;
@@ -55,86 +140,188 @@ typedef struct date {
 
 
 typedef struct vehicle_log {
-    char *license_plate;        /**< License plate of the vehicle. */
-    char *parking_name;         /**< Name of the parking. */
-    date *entry_date;           /**< Entry date of the vehicle. */
-    date *exit_date;            /**< Exit date of the vehicle. */
-    double cost;                /**< Cost of parking. */
-    struct vehicle_log *next;   /**< Pointer to the next vehicle log. */
+    plate license_plate;        /**< License plate of the vehicle. */
+    money cost;                 /**< Cost of parking. */
+    struct vehicle_log *next;   /**< Pointer to the next log of the vehicle in the same parking. */
+    struct vehicle_log *next_in_day; /**< Pointer to the next exit of the billing day. */
+    timestamp entry_date;       /**< Entry date of the vehicle. */
+    timestamp exit_date;        /**< Exit date of the vehicle, NO_DATE while parked. */
+    version entry_version;      /**< Version of the entry. */
+    version exit_version;       /**< Version of the exit, NO_VERSION while parked. */
 } vehicle_log;
 
-typedef struct {
-    char *license_plate;        /**< License plate of the vehicle. */
-    char *parking_name;         /**< Name of the parking. */
+typedef struct parking_history {
+    struct parking *my_parking;     /**< Parking of the logs. */
+    struct vehicle *my_vehicle;     /**< Vehicle of the logs. */
+    vehicle_log *first_log;         /**< Pointer to the first log of the vehicle in the parking. */
+    vehicle_log *last_log;          /**< Pointer to the last log of the vehicle in the parking. */
+    struct parking_history *next;   /**< Pointer to the history of the next parking by name. */
+    struct parking_history *prev;   /**< Pointer to the history of the previous parking by name. */
+    struct parking_history *next_in_parking; /**< Pointer to the history of another vehicle in the parking. */
+} parking_history;
+
+typedef struct vehicle {
+    plate license_plate;        /**< License plate of the vehicle. */
+    int parking_id;             /**< Id of the parking where it is parked. */
     int is_parked;              /**< Flag indicating whether the vehicle is parked. */
-    vehicle_log *my_logs;       /**< Pointer to the first log of the vehicle. */
-    vehicle_log *my_last_log;   /**< Pointer to the last log of the vehicle. */
+    parking_history *histories; /**< Logs of the vehicle grouped by parking, sorted by name. */
+    parking_history *last_history; /**< Pointer to the history of the last entry. */
 } vehicle;
 
 typedef struct billing_day {
-    date *exit_date;                /**< Date of the billing day. */
-    double total_cost;              /**< Total cost incurred on this billing day. */
+    timestamp exit_date;            /**< Date of the first exit of the billing day. */
+    money total_cost;               /**< Total cost incurred on this billing day. */
+    money cumulative_cost;          /**< Total cost of this and all the previous billing days. */
     vehicle_log *last_vehicle_log; /**< Pointer to the last vehicle log of the billing day. */
-    vehicle_log *vehicle_log;       /**< Pointer to the first vehicle log of the billing day. */
-    struct billing_day *next;       /**< Pointer to the next billing day. */
+    vehicle_log *vehicle_log;       /**< Pointer to the first vehicle log of the billing day, 
+                                         shared with the vehicle history. */
 } billing_day;
 
-typedef struct {
+typedef struct replaced_days {
+    billing_day *billing_days;      /**< Billing days array replaced when it grew. */
+    int billing_capacity;           /**< Capacity of the array. */
+    struct replaced_days *next;     /**< Next array replaced before. */
+} replaced_days;
+
+/** Costs of a parking from a date on, the stays are charged with the
+ * tariff in effect at their exit. */
+typedef struct tariff {
+    timestamp effective_date;           /**< First exit date it charges, 0 for the tariff of the creation. */
+    money cost_x, cost_y, cost_z;       /**< Costs of the periods of the first hour, of the others and of a day. */
+    money charges[PERIODS_IN_DAY + 1];  /**< Charge of each number of periods after the whole days. */
+    struct tariff *next;                /**< Tariff in effect before it. */
+} tariff;
+
+typedef struct parking {
     char *name;                         /**< Name of the parking. */
+    int id;                             /**< Stable id of the parking. */
     int max_capacity;                   /**< Maximum capacity of the parking. */
-    double cost_x, cost_y, cost_z;      /**< Costs for different vehicle sizes. */
+    tariff *tariffs;                    /**< Tariffs of the parking, the newest effective date first. */
     int free_spaces;                    /**< Number of free parking spaces. */
-    billing_day *billing_day_log;       /**< Pointer to the first billing day of the parking. */
-    billing_day *last_billing_day_log; /**< Pointer to the last billing day of the parking. */
+    version removed_version;            /**< Version of the removal, NO_VERSION if not removed. */
+    version unlinked_version;           /**< Version when its last history was unlinked. */
+    struct parking *next_removed;       /**< Pointer to the next removed parking to reclaim. */
+    billing_day *billing_days;          /**< Billing days of the parking, sorted by date. */
+    int num_billing_days;               /**< Number of billing days. */
+    int billing_capacity;               /**< Capacity of the billing days array. */
+    int shared;                         /**< Flag indicating snapshots may read it while it changes. */
+    replaced_days *replaced;            /**< Billing days arrays replaced, kept while shared. */
+    pool log_pool;                      /**< Pool of the vehicle logs of the parking. */
+    parking_history *histories;         /**< Histories of the vehicles that entered the parking. */
+    pool history_pool;                  /**< Pool of the vehicle histories in the parking. */
 } parking;
 
-typedef struct entry {
-    char *key;           /**< Key for the hashtable entry. */
-    vehicle *value;      /**< Value associated with the key. */
-    struct entry *next;  /**< Pointer to the next entry in the hashtable. */
+typedef struct {
+    plate key;                      /**< Key for the hashtable entry, EMPTY_KEY if empty. */
+    vehicle *value;                 /**< Value associated with the key, NULL while it is inserted. */
 } entry;
 
+typedef struct entry_table {
+    int length;                     /**< Length of the entries (a power of 2). */
+    int migrated;                   /**< Number of entries of the old table taken to be moved. */
+    int moved;                      /**< Number of entries of the old table already moved. */
+    struct entry_table *old;        /**< Table before growing, NULL once all its entries were moved. */
+    struct entry_table *next_retired; /**< Next table replaced, while lookups may still read it. */
+    entry entries[];                /**< The entries. */
+} entry_table;
+
 typedef struct {
-   entry *entries;    /**< Array of hashtable entries. */
-   int length;        /**< Length of the hashtable. */
-   int num_entries;   /**< Number of entries in the hashtable. */
+   entry_table *table;    /**< Current table of entries. */
+   int num_entries;       /**< Number of entries in the hashtable. */
+   int shared;            /**< Flag indicating other threads may look up vehicles. */
+   entry_table *retired;  /**< Tables replaced, freed with the hashtable if shared. */
+   pthread_rwlock_t grow_lock; /**< Shared by the insertions, exclusive to grow. */
+   pool vehicle_pool;     /**< Pool of the vehicles of the hashtable. */
 } hashtable;
 
 typedef struct {
-    parking *parkings[MAX_PARKINGS]; /**< Array of parkings. */
+    parking **parkings;     /**< Parkings indexed by id, NULL once removed. */
+    int num_ids;            /**< Number of ids given so far. */
+    int capacity;           /**< Capacity of the parkings array. */
+    parking **sorted;       /**< Existing parkings sorted by name. */
+    int num_parkings;       /**< Number of existing parkings. */
+    int *name_index;        /**< Hash index of the parking ids by name. */
+    int index_length;       /**< Length of the name index (a power of 2). */
+    int index_used;         /**< Number of slots of the name index not empty. */
+    parking *removed;       /**< Removed parkings still to reclaim, oldest first. */
+    parking *last_removed;  /**< Pointer to the last removed parking to reclaim. */
+} parking_registry;
+
+/** Part of a command that only reads and changes its parking (its logs,
+ * billing days and tariffs), so it can run on the worker that owns the parking,
+ * or that only reads the logs (v and f), so it can run from a snapshot. */
+typedef struct {
+    char command;                   /**< Character of the command (e, s, v, f, t, c or R). */
+    parking *my_parking;            /**< Parking of the command, NULL for v. */
+    parking_history *history;       /**< History of the vehicle in the parking (e and s). */
+    hashtable *vehicles;            /**< Hashtable of the vehicle of v. */
+    plate license_plate;            /**< License plate of the vehicle of v. */
+    timestamp first_date;           /**< Date of e and s, day of f (NO_DATE for all) or first day of t and R. */
+    timestamp last_date;            /**< Last day of t and R. */
+    tariff *new_tariff;             /**< Tariff added by c. */
+    int free_spaces;                /**< Free spaces of the parking after e. */
+    version command_version;        /**< Version of the command. */
+} parking_task;
+
+typedef struct {
+    parking_registry registry;      /**< Registry of parkings. */
     hashtable *vehicles;            /**< Hashtable of vehicles. */
-    date last_date;                 /**< Last date recorded. */
-    int park_counter;               /**< Counter for the number of parkings. */
+    timestamp last_date;            /**< Last date recorded, NO_DATE if none. */
     int num_logs;                   /**< Number of vehicle logs. */
+    version command_version;        /**< Version of the command running. */
+    struct shard_engine *engine;    /**< Workers of the parkings, NULL to run serially. */
+    const char *checkpoint_path;    /**< File of the checkpoints, NULL if none. */
+    struct wal_writer *wal;         /**< Log of the changes, NULL if none. */
+    uint64_t last_sequence;         /**< Sequence number of the last change logged, 0 if none. */
 } args;
 
 
 /* Functions to deal with command p*/
-int add_new_parking(args *parking_args,char *name, int max_capacity, double cost_x,double cost_y, double cost_z);
+int add_new_parking(args *parking_args,char *name, int max_capacity, money cost_x,money cost_y, money cost_z);
 void list_all_parkings(args *parking_args);
-void list_or_add_park(args *parking_args,char *buffer);
+void list_or_add_park(args *parking_args, command_line *line);
 
 
 /* Function to deal with command e*/
-void register_entry(args *parking_args,char *buffer);
+void register_entry(args *parking_args, command_line *line);
 
 
 /* Function to deal with command s*/
-void register_exit(args *parking_args,char *buffer);
+void register_exit(args *parking_args, command_line *line);
 
 
-/* Function to deal with command v*/
-void list_vehicle_logs(args *parking_args,char *buffer);
+/* Functions to deal with command v*/
+void list_vehicle_logs(args *parking_args, command_line *line);
+void show_vehicle_logs(hashtable *vehicles, plate license_plate, version snapshot);
 
 
 /* Functions to deal with command f*/
-void show_daily_summary( parking *my_parking);
-void show_revenue(args *parking_args, char *buffer);
-void show_day_revenue_list(args *parking_args, char *parking_name, date *revenue_date);
+void show_daily_summary(parking *my_parking, version snapshot);
+void show_revenue(args *parking_args, command_line *line);
+void show_day_revenue_list(parking *my_parking, timestamp revenue_date, version snapshot);
+
+
+/* Function to deal with command t*/
+void show_revenue_range(args *parking_args, command_line *line);
 
 
 /* Functions to deal with command r*/
-void remove_parking(args *parking_args, char *buffer);
+void remove_parking(args *parking_args, command_line *line);
+
+
+/* Functions to deal with command c*/
+void change_tariff(args *parking_args, command_line *line);
+
+
+/* Functions to deal with command R*/
+void reprice_stays(args *parking_args, command_line *line);
+void show_repricing(parking *my_parking, timestamp first_date, timestamp last_date);
+
+
+/* Functions to run any command*/
+void execute_command(args *parking_args, command_line *line);
+void run_parking_task(args *parking_args, parking_task *task);
+void execute_parking_task(parking_task *task, version snapshot);
 
 
 #endif // PROJ1_H
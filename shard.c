@@ -0,0 +1,456 @@
+/**
+ * File with the sharded execution engine.
+ * @file shard.c
+ * @author ist1106369 Sophia Alencar
+*/
+
+#include <sched.h>
+
+#include "shard.h"
+
+/**
+ * Writes the output of the oldest commands that are complete, in order.
+ * @param engine Pointer to the engine.
+ * @param wait Flag to wait until the output of all the commands is written.
+ */
+static void write_done_slots(shard_engine *engine, int wait) {
+    output_slot *slot;
+
+    while (engine->first_slot != engine->next_slot) {
+        slot = &engine->slots[engine->first_slot & (OUTPUT_SLOTS - 1)];
+        if (!__atomic_load_n(&slot->done, __ATOMIC_ACQUIRE)) {
+            if (!wait) {
+                return;
+            }
+            sched_yield();
+            continue;
+        }
+
+        if (slot->output.length > 0) {
+            output_bytes(slot->output.bytes, slot->output.length);
+            slot->output.length = 0;
+        }
+        slot->done = 0;
+        engine->first_slot++;
+    }
+}
+
+/**
+ * Gives the next output slot, waiting for the oldest one if all are used.
+ * @param engine Pointer to the engine.
+ * @return Number of the slot.
+ */
+static uint64_t get_output_slot(shard_engine *engine) {
+    while (engine->next_slot - engine->first_slot == OUTPUT_SLOTS) {
+        write_done_slots(engine, 0);
+        sched_yield();
+    }
+    return engine->next_slot++;
+}
+
+/**
+ * Waits for the next task of a worker, sleeping when there is none for a while.
+ * @param worker Pointer to the worker.
+ * @return 1 if there is a task, 0 if the worker must end.
+ */
+static int wait_for_task(shard_worker *worker) {
+    int spins;
+
+    for (spins = 0; spins < SPIN_LIMIT; spins++) {
+        if (__atomic_load_n(&worker->head, __ATOMIC_ACQUIRE) != worker->tail) {
+            return 1;
+        }
+    }
+
+    /** The main thread signals after adding a task if it sees the flag. */
+    pthread_mutex_lock(&worker->lock);
+    __atomic_store_n(&worker->sleeping, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&worker->head, __ATOMIC_SEQ_CST) == worker->tail &&
+        !worker->stop) {
+        pthread_cond_wait(&worker->wake, &worker->lock);
+    }
+    __atomic_store_n(&worker->sleeping, 0, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&worker->lock);
+
+    return __atomic_load_n(&worker->head, __ATOMIC_ACQUIRE) != worker->tail;
+}
+
+/**
+ * Waits for the workers to run the tasks added before a report, so the
+ * changes older than its snapshot are complete.
+ * @param engine Pointer to the engine.
+ * @param waits Version each worker must reach.
+ */
+static void wait_for_snapshot(shard_engine *engine, version *waits) {
+    int i;
+
+    for (i = 0; i < engine->num_workers; i++) {
+        while (__atomic_load_n(&engine->workers[i].done_version, __ATOMIC_ACQUIRE) < waits[i]) {
+            sched_yield();
+        }
+    }
+}
+
+/**
+ * Runs the tasks of a worker or of a reporting thread in order, each
+ * with its output captured in the slot of its command. Reports read 
+ * from the snapshot of their command.
+ * @param argument Pointer to the worker.
+ * @return NULL.
+ */
+static void *run_worker(void *argument) {
+    shard_worker *worker = (shard_worker *)argument;
+    shard_engine *engine = worker->engine;
+    queued_task *current_task;
+    output_slot *slot;
+    uint64_t position;
+    version snapshot;
+
+    while (wait_for_task(worker)) {
+        position = worker->tail & (WORKER_QUEUE_LENGTH - 1);
+        current_task = &worker->tasks[position];
+        slot = &engine->slots[current_task->slot & (OUTPUT_SLOTS - 1)];
+
+        snapshot = NO_VERSION;
+        if (worker->waits != NULL) {
+            wait_for_snapshot(engine, &worker->waits[position * engine->num_workers]);
+            snapshot = current_task->task.command_version;
+        }
+
+        /** The errors of a report are counted on its command type. */
+        if (stats_enabled && worker->waits != NULL) {
+            start_command_stats(current_task->task.command);
+        }
+        capture_output(&slot->output);
+        execute_parking_task(&current_task->task, snapshot);
+        capture_output(NULL);
+        if (stats_enabled && worker->waits != NULL) {
+            stop_command_stats();
+        }
+
+        __atomic_store_n(&slot->done, 1, __ATOMIC_RELEASE);
+        __atomic_store_n(&worker->done_version, current_task->task.command_version,
+            __ATOMIC_RELEASE);
+        __atomic_store_n(&worker->tail, worker->tail + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/**
+ * Waits for the workers to run all their tasks, writing the output done
+ * meanwhile, so it must not be called while the output is captured.
+ * The reporting threads may still run.
+ * @param engine Pointer to the engine.
+ */
+void wait_shard_workers(shard_engine *engine) {
+    shard_worker *worker;
+    int i;
+
+    for (i = 0; i < engine->num_workers; i++) {
+        worker = &engine->workers[i];
+        while (__atomic_load_n(&worker->tail, __ATOMIC_ACQUIRE) != worker->head) {
+            write_done_slots(engine, 0);
+            sched_yield();
+        }
+    }
+}
+
+/**
+ * Wakes a worker if it is sleeping.
+ * @param worker Pointer to the worker.
+ */
+static void wake_worker(shard_worker *worker) {
+    if (__atomic_load_n(&worker->sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&worker->lock);
+        pthread_cond_signal(&worker->wake);
+        pthread_mutex_unlock(&worker->lock);
+    }
+}
+
+/**
+ * Frees the queue of a worker and, of a reporting thread, its waits.
+ * @param worker Pointer to the worker.
+ */
+static void free_worker_queue(shard_worker *worker) {
+    tracked_free(worker->tasks, sizeof(queued_task) * WORKER_QUEUE_LENGTH, ALLOC_OTHER);
+    tracked_free(worker->waits, sizeof(version) * WORKER_QUEUE_LENGTH *
+        worker->engine->num_workers, ALLOC_OTHER);
+}
+
+/**
+ * Starts the thread of a worker or of a reporting thread.
+ * @param engine Pointer to the engine.
+ * @param worker Pointer to the worker, zeroed.
+ * @param is_reporter Flag indicating it runs the reports.
+ * @return 0 on success, -1 if it could not be started.
+ */
+static int start_worker(shard_engine *engine, shard_worker *worker, int is_reporter) {
+    worker->engine = engine;
+    if ((worker->tasks = (queued_task *)tracked_malloc(sizeof(queued_task) *
+        WORKER_QUEUE_LENGTH, ALLOC_OTHER)) == NULL) {
+        return -1;
+    }
+    if (is_reporter && (worker->waits = (version *)tracked_malloc(sizeof(version) *
+        WORKER_QUEUE_LENGTH * engine->num_workers, ALLOC_OTHER)) == NULL) {
+        tracked_free(worker->tasks, sizeof(queued_task) * WORKER_QUEUE_LENGTH, ALLOC_OTHER);
+        return -1;
+    }
+    pthread_mutex_init(&worker->lock, NULL);
+    pthread_cond_init(&worker->wake, NULL);
+    if (pthread_create(&worker->thread, NULL, run_worker, worker) != 0) {
+        pthread_mutex_destroy(&worker->lock);
+        pthread_cond_destroy(&worker->wake);
+        free_worker_queue(worker);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Ends the thread of a worker and frees its queue.
+ * @param worker Pointer to the worker.
+ */
+static void stop_worker(shard_worker *worker) {
+    pthread_mutex_lock(&worker->lock);
+    worker->stop = 1;
+    pthread_cond_signal(&worker->wake);
+    pthread_mutex_unlock(&worker->lock);
+    pthread_join(worker->thread, NULL);
+
+    pthread_mutex_destroy(&worker->lock);
+    pthread_cond_destroy(&worker->wake);
+    free_worker_queue(worker);
+}
+
+/**
+ * Frees the arrays of an engine and the engine.
+ * @param engine Pointer to the engine.
+ * @param num_workers Number of workers the array was allocated for.
+ * @param num_reporters Number of reporting threads the array was allocated for.
+ */
+static void free_shard_engine(shard_engine *engine, int num_workers, int num_reporters) {
+    tracked_free(engine->workers, sizeof(shard_worker) * num_workers, ALLOC_OTHER);
+    tracked_free(engine->reporters, sizeof(shard_worker) *
+        (num_reporters > 0 ? num_reporters : 1), ALLOC_OTHER);
+    tracked_free(engine->slots, sizeof(output_slot) * OUTPUT_SLOTS, ALLOC_OTHER);
+    tracked_free(engine, sizeof(shard_engine), ALLOC_OTHER);
+}
+
+/**
+ * Waits for the workers and the reporting threads that started, ends
+ * them and frees the output of the slots.
+ * @param engine Pointer to the engine.
+ */
+static void stop_shard_threads(shard_engine *engine) {
+    int i;
+
+    wait_shard_engine(engine);
+    for (i = 0; i < engine->num_reporters; i++) {
+        stop_worker(&engine->reporters[i]);
+    }
+    for (i = 0; i < engine->num_workers; i++) {
+        stop_worker(&engine->workers[i]);
+    }
+    for (i = 0; i < OUTPUT_SLOTS; i++) {
+        tracked_free(engine->slots[i].output.bytes, engine->slots[i].output.capacity,
+            ALLOC_BUFFER);
+    }
+}
+
+/**
+ * Starts the workers and the reporting threads of an engine.
+ * @param num_workers Number of workers, from 1 to MAX_WORKERS.
+ * @param num_reporters Number of reporting threads, from 0 to MAX_REPORTERS.
+ * @return Pointer to the engine, or NULL if it could not be started.
+ */
+shard_engine *start_shard_engine(int num_workers, int num_reporters) {
+    shard_engine *engine;
+
+    if (num_workers < 1 || num_workers > MAX_WORKERS || num_reporters < 0 ||
+        num_reporters > MAX_REPORTERS ||
+        (engine = (shard_engine *)tracked_malloc(sizeof(shard_engine), ALLOC_OTHER)) == NULL) {
+        return NULL;
+    }
+    engine->workers = (shard_worker *)tracked_calloc(num_workers, sizeof(shard_worker),
+        ALLOC_OTHER);
+    engine->reporters = (shard_worker *)tracked_calloc(num_reporters > 0 ? num_reporters : 1,
+        sizeof(shard_worker), ALLOC_OTHER);
+    engine->slots = (output_slot *)tracked_calloc(OUTPUT_SLOTS, sizeof(output_slot),
+        ALLOC_OTHER);
+    if (engine->workers == NULL || engine->reporters == NULL || engine->slots == NULL) {
+        free_shard_engine(engine, num_workers, num_reporters);
+        return NULL;
+    }
+    engine->num_workers = 0;
+    engine->num_reporters = 0;
+    engine->next_reporter = 0;
+    engine->first_slot = 0;
+    engine->next_slot = 0;
+    engine->command_slot = NO_SLOT;
+    engine->routed = 0;
+
+    while (engine->num_workers < num_workers &&
+        start_worker(engine, &engine->workers[engine->num_workers], 0) == 0) {
+        engine->num_workers++;
+    }
+
+    /** The reports wait for all the workers, so they start once all are running. */
+    while (engine->num_workers == num_workers && engine->num_reporters < num_reporters &&
+        start_worker(engine, &engine->reporters[engine->num_reporters], 1) == 0) {
+        engine->num_reporters++;
+    }
+
+    if (engine->num_workers < num_workers || engine->num_reporters < num_reporters) {
+        stop_shard_threads(engine);
+        free_shard_engine(engine, num_workers, num_reporters);
+        return NULL;
+    }
+    return engine;
+}
+
+/**
+ * Prepares the engine for a command: commands that read the logs of
+ * any parking wait for all the workers, unless they are reports and
+ * there are reporting threads, and while older output is not written
+ * the output of the command is captured in a slot.
+ * @param engine Pointer to the engine.
+ * @param command Character of the command.
+ */
+void begin_sharded_command(shard_engine *engine, char command) {
+    if (command != '\0' && strchr(FLUSH_COMMANDS, command) != NULL) {
+        wait_shard_engine(engine);
+        return;
+    }
+    if (command != '\0' && strchr(BARRIER_COMMANDS, command) != NULL &&
+        (engine->num_reporters == 0 || strchr(REPORT_COMMANDS, command) == NULL)) {
+        wait_shard_workers(engine);
+    }
+    if (engine->first_slot != engine->next_slot) {
+        engine->command_slot = get_output_slot(engine);
+        capture_output(&engine->slots[engine->command_slot & (OUTPUT_SLOTS - 1)].output);
+    }
+}
+
+/**
+ * Adds a task to the worker of its parking, or a report to the next
+ * reporting thread, with the versions of the workers it waits for. Its
+ * output goes to the slot of the command, which has no other output.
+ * @param engine Pointer to the engine.
+ * @param task The task, copied.
+ * @return 1 if it was added, 0 if it must run right away (v without
+ * reporting threads, after the workers).
+ */
+int route_parking_task(shard_engine *engine, parking_task *task) {
+    shard_worker *worker;
+    queued_task *new_task;
+    version *waits;
+    int i;
+
+    if (engine->num_reporters > 0 && strchr(REPORT_COMMANDS, task->command) != NULL) {
+        worker = &engine->reporters[engine->next_reporter];
+        engine->next_reporter = (engine->next_reporter + 1) % engine->num_reporters;
+    } else if (task->my_parking != NULL) {
+        worker = &engine->workers[task->my_parking->id % engine->num_workers];
+    } else {
+        return 0;
+    }
+
+    if (engine->command_slot == NO_SLOT) {
+        engine->command_slot = get_output_slot(engine);
+    }
+    engine->routed = 1;
+
+    /** Wait for space in the queue, writing the output done meanwhile. */
+    while (worker->head - __atomic_load_n(&worker->tail, __ATOMIC_ACQUIRE) ==
+        WORKER_QUEUE_LENGTH) {
+        write_done_slots(engine, 0);
+        sched_yield();
+    }
+
+    new_task = &worker->tasks[worker->head & (WORKER_QUEUE_LENGTH - 1)];
+    new_task->task = *task;
+    new_task->slot = engine->command_slot;
+    if (worker->waits != NULL) {
+        waits = &worker->waits[(worker->head & (WORKER_QUEUE_LENGTH - 1)) * engine->num_workers];
+        for (i = 0; i < engine->num_workers; i++) {
+            waits[i] = engine->workers[i].routed_version;
+        }
+    }
+    worker->routed_version = task->command_version;
+    __atomic_store_n(&worker->head, worker->head + 1, __ATOMIC_SEQ_CST);
+    wake_worker(worker);
+    return 1;
+}
+
+/**
+ * Gets the version of the oldest report not yet done, whose snapshot
+ * must still see the parkings removed after it.
+ * @param engine Pointer to the engine.
+ * @return The version, NO_VERSION if all the reports are done.
+ */
+version get_oldest_report(shard_engine *engine) {
+    shard_worker *reporter;
+    version oldest = NO_VERSION;
+    uint64_t tail;
+    int i;
+
+    /** The reports of each reporting thread are in version order. */
+    for (i = 0; i < engine->num_reporters; i++) {
+        reporter = &engine->reporters[i];
+        tail = __atomic_load_n(&reporter->tail, __ATOMIC_ACQUIRE);
+        if (tail != reporter->head &&
+            reporter->tasks[tail & (WORKER_QUEUE_LENGTH - 1)].task.command_version < oldest) {
+            oldest = reporter->tasks[tail & (WORKER_QUEUE_LENGTH - 1)].task.command_version;
+        }
+    }
+    return oldest;
+}
+
+/**
+ * Gives the next task of a command its own output slot, after the
+ * output of the command so far, so a command with a task for each
+ * parking keeps their output in order while they run in parallel.
+ * @param engine Pointer to the engine.
+ */
+void split_sharded_output(shard_engine *engine) {
+    if (engine->command_slot != NO_SLOT && !engine->routed) {
+        capture_output(NULL);
+        engine->slots[engine->command_slot & (OUTPUT_SLOTS - 1)].done = 1;
+    }
+    engine->command_slot = NO_SLOT;
+    engine->routed = 0;
+}
+
+/**
+ * Ends a command: its slot is complete unless a worker runs its task,
+ * and the output of the commands done is written.
+ * @param engine Pointer to the engine.
+ */
+void end_sharded_command(shard_engine *engine) {
+    capture_output(NULL);
+    if (engine->command_slot != NO_SLOT && !engine->routed) {
+        engine->slots[engine->command_slot & (OUTPUT_SLOTS - 1)].done = 1;
+    }
+    engine->command_slot = NO_SLOT;
+    engine->routed = 0;
+
+    write_done_slots(engine, 0);
+}
+
+/**
+ * Waits for the workers and the reporting threads to run all their
+ * tasks, writing all the output.
+ * @param engine Pointer to the engine.
+ */
+void wait_shard_engine(shard_engine *engine) {
+    write_done_slots(engine, 1);
+}
+
+/**
+ * Waits for the workers and the reporting threads, ends them and frees the engine.
+ * @param engine Pointer to the engine.
+ */
+void stop_shard_engine(shard_engine *engine) {
+    stop_shard_threads(engine);
+    free_shard_engine(engine, engine->num_workers, engine->num_reporters);
+}
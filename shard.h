@@ -0,0 +1,99 @@
+/**
+ * File with the sharded execution engine: each parking is owned by a
+ * worker thread that runs the parts of the commands that only change
+ * the parking, reporting threads run the v and f reports from a snapshot,
+ * while the main thread reads the commands, keeps the vehicles and the
+ * dates, and writes the output in the order of the commands.
+ * @file shard.h
+ * @author ist1106369 Sophia Alencar
+*/
+
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <pthread.h>
+
+#include "proj1.h"
+
+/** Max number of workers. */
+#define MAX_WORKERS 64
+
+/** Max number of reporting threads. */
+#define MAX_REPORTERS 16
+
+/** Number of tasks waiting in each worker (a power of 2). */
+#define WORKER_QUEUE_LENGTH 1024
+
+/** Number of commands whose output is not yet written (a power of 2). */
+#define OUTPUT_SLOTS 4096
+
+/** Number of times an idle worker checks its queue before sleeping. */
+#define SPIN_LIMIT 256
+
+/** Commands that read the logs of any parking, so they wait for all the
+ * workers (v only without reporting threads). */
+#define BARRIER_COMMANDS "vrW"
+
+/** Commands that write to stdout themselves, or that change the logs the
+ * reports already sent may read (R), so they wait for all the output. */
+#define FLUSH_COMMANDS "SR"
+
+/** Commands that only read the logs, run by the reporting threads. */
+#define REPORT_COMMANDS "vf"
+
+/** Command without an output slot. */
+#define NO_SLOT UINT64_MAX
+
+/** Structs. */
+
+typedef struct {
+    output_buffer output;           /**< Output of the command. */
+    int done;                       /**< Flag indicating the output is complete. */
+} output_slot;
+
+typedef struct {
+    parking_task task;              /**< The part of the command to run. */
+    uint64_t slot;                  /**< Number of the output slot of the command. */
+} queued_task;
+
+typedef struct shard_worker {
+    struct shard_engine *engine;    /**< Engine of the worker. */
+    queued_task *tasks;             /**< Queue of the tasks, a ring. */
+    version *waits;                 /**< Version each worker must reach before each
+                                         task of a reporting thread. */
+    uint64_t head;                  /**< Number of tasks added, by the main thread. */
+    uint64_t tail;                  /**< Number of tasks done, by the worker. */
+    version routed_version;         /**< Version of the last task added, by the main thread. */
+    version done_version;           /**< Version of the last task done, by the worker. */
+    int sleeping;                   /**< Flag indicating the worker waits for tasks. */
+    int stop;                       /**< Flag asking the worker to end. */
+    pthread_mutex_t lock;           /**< Lock of the sleeping and stop flags. */
+    pthread_cond_t wake;            /**< Signaled when a task is added or to stop. */
+    pthread_t thread;               /**< Thread of the worker. */
+} shard_worker;
+
+typedef struct shard_engine {
+    shard_worker *workers;          /**< The workers, parking id modulo their number. */
+    int num_workers;                /**< Number of workers. */
+    shard_worker *reporters;        /**< The reporting threads, taking the reports in turns. */
+    int num_reporters;              /**< Number of reporting threads. */
+    int next_reporter;              /**< Reporting thread of the next report. */
+    output_slot *slots;             /**< Output of the commands not yet written, a ring. */
+    uint64_t first_slot;            /**< Number of the oldest slot not written. */
+    uint64_t next_slot;             /**< Number of the next slot to give. */
+    uint64_t command_slot;          /**< Slot of the command running, NO_SLOT if none. */
+    int routed;                     /**< Flag indicating the command running has a task. */
+} shard_engine;
+
+/** Engine functions. */
+shard_engine *start_shard_engine(int num_workers, int num_reporters);
+void begin_sharded_command(shard_engine *engine, char command);
+int route_parking_task(shard_engine *engine, parking_task *task);
+version get_oldest_report(shard_engine *engine);
+void split_sharded_output(shard_engine *engine);
+void end_sharded_command(shard_engine *engine);
+void wait_shard_workers(shard_engine *engine);
+void wait_shard_engine(shard_engine *engine);
+void stop_shard_engine(shard_engine *engine);
+
+#endif // SHARD_H
@@ -0,0 +1,372 @@
+/**
+ * File with the command statistics: counts, errors, latency histograms
+ * and allocations.
+ * @file stats.c
+ * @author ist1106369 Sophia Alencar
+*/
+
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+/** Flag indicating the statistics are collected. */
+int stats_enabled = 0;
+
+/** Flag indicating the allocations are tracked. */
+int alloc_stats_enabled = 0;
+
+/** Allocations of each structure. */
+static alloc_stats all_allocs[NUM_ALLOC_TYPES];
+
+/** Live bytes of all the structures, and their largest number. */
+static uint64_t total_live_bytes = 0, total_peak_bytes = 0;
+
+/** Statistics of each command type. */
+static command_stats all_stats[NUM_STATS_COMMANDS];
+
+/** Statistics of the command running on each thread, NULL if stats
+ * are disabled (reporting threads count the errors of their reports). */
+static __thread command_stats *current_stats = NULL;
+
+/** Names of the errors, in the order of their numbers. */
+static const char *error_names[NUM_ERRORS] = {
+    "invalid capacity", "invalid cost", "parking already exists", "no such parking",
+    "parking is full", "invalid licence plate", "invalid vehicle entry",
+    "invalid vehicle exit", "invalid date", "no entries found"
+};
+
+/** Names of the tracked structures, in the order of their numbers. */
+static const char *alloc_names[NUM_ALLOC_TYPES] = {
+    "vehicle", "vehicle_log", "history", "billing_day", "entry", "string",
+    "parking", "registry", "input", "buffer", "other"
+};
+
+/**
+ * Starts collecting statistics.
+ */
+void enable_stats(void) {
+    stats_enabled = 1;
+}
+
+/**
+ * Gets the current time of a monotonic clock.
+ * @return The time in nanoseconds.
+ */
+uint64_t stats_clock(void) {
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000u + time.tv_nsec;
+}
+
+/**
+ * Gets the histogram bucket of a latency: exact below 16 ns, then 16
+ * buckets for each power of two (about 6% of error).
+ * @param latency The latency in nanoseconds.
+ * @return The bucket.
+ */
+static int get_bucket(uint64_t latency) {
+    int exponent;
+
+    if (latency < HISTOGRAM_SUB_BUCKETS) {
+        return (int)latency;
+    }
+
+    exponent = 63 - __builtin_clzll(latency);
+    return (exponent - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS +
+        (int)((latency >> (exponent - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+/**
+ * Records a block allocated, on its structure and on the command running.
+ * @param size Size of the block.
+ * @param type The structure of the block.
+ */
+static void record_alloc(size_t size, int type) {
+    alloc_stats *allocs = &all_allocs[type];
+
+    allocs->allocs++;
+    allocs->alloc_bytes += size;
+    allocs->live_bytes += size;
+    if (allocs->live_bytes > allocs->peak_bytes) {
+        allocs->peak_bytes = allocs->live_bytes;
+    }
+    total_live_bytes += size;
+    if (total_live_bytes > total_peak_bytes) {
+        total_peak_bytes = total_live_bytes;
+    }
+    if (current_stats != NULL) {
+        current_stats->allocs++;
+        current_stats->alloc_bytes += size;
+    }
+}
+
+/**
+ * Records a block freed, on its structure and on the command running.
+ * @param size Size of the block.
+ * @param type The structure of the block.
+ */
+static void record_free(size_t size, int type) {
+    all_allocs[type].frees++;
+    all_allocs[type].live_bytes -= size;
+    total_live_bytes -= size;
+    if (current_stats != NULL) {
+        current_stats->frees++;
+    }
+}
+
+/**
+ * Gets the smallest latency of a histogram bucket.
+ * @param bucket The bucket.
+ * @return The latency in nanoseconds.
+ */
+static uint64_t get_bucket_latency(int bucket) {
+    int exponent = bucket / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BITS - 1;
+
+    if (bucket < HISTOGRAM_SUB_BUCKETS) {
+        return (uint64_t)bucket;
+    }
+
+    return ((uint64_t)(HISTOGRAM_SUB_BUCKETS | (bucket & (HISTOGRAM_SUB_BUCKETS - 1))))
+        << (exponent - HISTOGRAM_SUB_BITS);
+}
+
+/**
+ * Starts the statistics of a command, its errors are counted on its type.
+ * @param command Character of the command.
+ */
+void start_command_stats(char command) {
+    const char *position = command != '\0' ? strchr(STATS_COMMANDS, command) : NULL;
+
+    current_stats = &all_stats[position != NULL ? position - STATS_COMMANDS :
+        NUM_STATS_COMMANDS - 1];
+}
+
+/**
+ * Ends the statistics of the command started last, recording its latency.
+ * @param start Time the command started, from stats_clock.
+ */
+void end_command_stats(uint64_t start) {
+    uint64_t latency = stats_clock() - start;
+
+    current_stats->count++;
+    current_stats->total_time += latency;
+    if (latency > current_stats->max_time) {
+        current_stats->max_time = latency;
+    }
+    current_stats->histogram[get_bucket(latency)]++;
+
+    /** Allocations between commands are not counted on any command. */
+    current_stats = NULL;
+}
+
+/**
+ * Stops counting on the command started last without recording a
+ * latency, for the reports run on other threads.
+ */
+void stop_command_stats(void) {
+    current_stats = NULL;
+}
+
+/**
+ * Counts an error printed by the command running.
+ * @param error The number of the error.
+ */
+void count_error(int error) {
+    if (stats_enabled && current_stats != NULL) {
+        __atomic_fetch_add(&current_stats->errors[error], 1, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Gets a percentile of the latencies of a command type.
+ * @param stats Pointer to the statistics of the command type.
+ * @param percentile The percentile, from 0 to 100.
+ * @return The smallest latency of the bucket of the percentile, in nanoseconds.
+ */
+uint64_t get_latency_percentile(command_stats *stats, double percentile) {
+    uint64_t target = (uint64_t)(percentile / 100 * stats->count + 0.5), seen = 0;
+    int bucket;
+
+    if (target == 0) {
+        target = 1;
+    }
+    for (bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        seen += stats->histogram[bucket];
+        if (seen >= target) {
+            return get_bucket_latency(bucket);
+        }
+    }
+    return stats->max_time;
+}
+
+/**
+ * Prints the statistics of each command type that ran.
+ * @param stream Stream to print to.
+ */
+void print_stats(FILE *stream) {
+    command_stats *stats;
+    uint64_t errors;
+    int type, error;
+
+    fprintf(stream, "command %10s %10s %10s %10s %10s %10s\n", "count", "errors",
+        "mean us", "p50 us", "p99 us", "max us");
+    for (type = 0; type < NUM_STATS_COMMANDS; type++) {
+        stats = &all_stats[type];
+        if (stats->count == 0) {
+            continue;
+        }
+        errors = 0;
+        for (error = 0; error < NUM_ERRORS; error++) {
+            errors += stats->errors[error];
+        }
+        fprintf(stream, "%-7c %10llu %10llu %10.2f %10.2f %10.2f %10.2f\n", STATS_COMMANDS[type],
+            (unsigned long long)stats->count, (unsigned long long)errors,
+            stats->total_time / 1000.0 / stats->count,
+            get_latency_percentile(stats, 50) / 1000.0,
+            get_latency_percentile(stats, 99) / 1000.0, stats->max_time / 1000.0);
+    }
+
+    /** Errors of each command type. */
+    for (type = 0; type < NUM_STATS_COMMANDS; type++) {
+        for (error = 0; error < NUM_ERRORS; error++) {
+            if (all_stats[type].errors[error] > 0) {
+                fprintf(stream, "%c %s: %llu\n", STATS_COMMANDS[type], error_names[error],
+                    (unsigned long long)all_stats[type].errors[error]);
+            }
+        }
+    }
+
+    if (alloc_stats_enabled) {
+        print_alloc_stats(stream);
+    }
+}
+
+/**
+ * Starts tracking the allocations, with the statistics of the commands.
+ */
+void enable_alloc_stats(void) {
+    stats_enabled = 1;
+    alloc_stats_enabled = 1;
+}
+
+/**
+ * Allocates a block with malloc, tracking it when enabled.
+ * @param size Size of the block.
+ * @param type The structure of the block.
+ * @return Pointer to the block, or NULL if it could not be allocated.
+ */
+void *tracked_malloc(size_t size, int type) {
+    void *pointer = malloc(size);
+
+    if (alloc_stats_enabled && pointer != NULL) {
+        record_alloc(size, type);
+    }
+    return pointer;
+}
+
+/**
+ * Allocates a zeroed block with calloc, tracking it when enabled.
+ * @param count Number of elements of the block.
+ * @param size Size of each element.
+ * @param type The structure of the block.
+ * @return Pointer to the block, or NULL if it could not be allocated.
+ */
+void *tracked_calloc(size_t count, size_t size, int type) {
+    void *pointer = calloc(count, size);
+
+    if (alloc_stats_enabled && pointer != NULL) {
+        record_alloc(count * size, type);
+    }
+    return pointer;
+}
+
+/**
+ * Resizes a block with realloc, tracking it as a free of the old
+ * block and an allocation of the new one when enabled.
+ * @param pointer Pointer to the block, or NULL.
+ * @param old_size Size of the block, 0 if pointer is NULL.
+ * @param new_size New size of the block.
+ * @param type The structure of the block.
+ * @return Pointer to the resized block, or NULL if it could not be allocated.
+ */
+void *tracked_realloc(void *pointer, size_t old_size, size_t new_size, int type) {
+    void *new_pointer = realloc(pointer, new_size);
+
+    if (alloc_stats_enabled && new_pointer != NULL) {
+        if (pointer != NULL) {
+            record_free(old_size, type);
+        }
+        record_alloc(new_size, type);
+    }
+    return new_pointer;
+}
+
+/**
+ * Frees a block, tracking it when enabled.
+ * @param pointer Pointer to the block, or NULL.
+ * @param size Size of the block.
+ * @param type The structure of the block.
+ */
+void tracked_free(void *pointer, size_t size, int type) {
+    if (alloc_stats_enabled && pointer != NULL) {
+        record_free(size, type);
+    }
+    free(pointer);
+}
+
+/**
+ * Counts an object given by a pool, from a block already tracked.
+ * @param type The structure of the object.
+ */
+void track_object(int type) {
+    if (alloc_stats_enabled) {
+        all_allocs[type].objects++;
+    }
+}
+
+/**
+ * Prints the allocations of each command type that ran, and the
+ * allocations and the live memory of each structure.
+ * @param stream Stream to print to.
+ */
+void print_alloc_stats(FILE *stream) {
+    command_stats *stats;
+    alloc_stats *allocs, total = { 0, 0, 0, 0, 0, 0 };
+    int type;
+
+    fprintf(stream, "command %10s %10s %12s %12s\n", "allocs", "frees", "bytes",
+        "bytes/cmd");
+    for (type = 0; type < NUM_STATS_COMMANDS; type++) {
+        stats = &all_stats[type];
+        if (stats->count == 0) {
+            continue;
+        }
+        fprintf(stream, "%-7c %10llu %10llu %12llu %12.1f\n", STATS_COMMANDS[type],
+            (unsigned long long)stats->allocs, (unsigned long long)stats->frees,
+            (unsigned long long)stats->alloc_bytes, (double)stats->alloc_bytes / stats->count);
+    }
+
+    fprintf(stream, "%-11s %10s %10s %10s %12s %12s %12s\n", "structure", "allocs",
+        "frees", "objects", "bytes", "live bytes", "peak bytes");
+    for (type = 0; type < NUM_ALLOC_TYPES; type++) {
+        allocs = &all_allocs[type];
+        total.allocs += allocs->allocs;
+        total.frees += allocs->frees;
+        total.objects += allocs->objects;
+        total.alloc_bytes += allocs->alloc_bytes;
+        if (allocs->allocs == 0) {
+            continue;
+        }
+        fprintf(stream, "%-11s %10llu %10llu %10llu %12llu %12llu %12llu\n", alloc_names[type],
+            (unsigned long long)allocs->allocs, (unsigned long long)allocs->frees,
+            (unsigned long long)allocs->objects, (unsigned long long)allocs->alloc_bytes,
+            (unsigned long long)allocs->live_bytes, (unsigned long long)allocs->peak_bytes);
+    }
+
+    fprintf(stream, "%-11s %10llu %10llu %10llu %12llu %12llu %12llu\n", "total",
+        (unsigned long long)total.allocs, (unsigned long long)total.frees,
+        (unsigned long long)total.objects, (unsigned long long)total.alloc_bytes,
+        (unsigned long long)total_live_bytes, (unsigned long long)total_peak_bytes);
+}
@@ -0,0 +1,100 @@
+/**
+ * File with the command statistics: counts, errors, latency histograms
+ * and allocations.
+ * @file stats.h
+ * @author ist1106369 Sophia Alencar
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/** Command characters with their own statistics, the others count as '?'. */
+#define STATS_COMMANDS "pesvftrcR?"
+#define NUM_STATS_COMMANDS 10
+
+/** Sub-buckets of each power of two of the latency histograms. */
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+
+/** Number of buckets to hold any 64 bit latency. */
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+/** Errors printed by the commands. */
+#define ERROR_INVALID_CAPACITY 0
+#define ERROR_INVALID_COST 1
+#define ERROR_PARKING_EXISTS 2
+#define ERROR_NO_SUCH_PARKING 3
+#define ERROR_PARKING_FULL 4
+#define ERROR_INVALID_PLATE 5
+#define ERROR_INVALID_ENTRY 6
+#define ERROR_INVALID_EXIT 7
+#define ERROR_INVALID_DATE 8
+#define ERROR_NO_ENTRIES 9
+#define NUM_ERRORS 10
+
+/** Structures whose allocations are tracked. */
+#define ALLOC_VEHICLE 0
+#define ALLOC_VEHICLE_LOG 1
+#define ALLOC_HISTORY 2
+#define ALLOC_BILLING_DAY 3
+#define ALLOC_ENTRY 4
+#define ALLOC_STRING 5
+#define ALLOC_PARKING 6
+#define ALLOC_REGISTRY 7
+#define ALLOC_INPUT 8
+#define ALLOC_BUFFER 9
+#define ALLOC_OTHER 10
+#define NUM_ALLOC_TYPES 11
+
+/** Structs. */
+
+typedef struct {
+    uint64_t count;                         /**< Number of commands. */
+    uint64_t errors[NUM_ERRORS];            /**< Number of each error printed. */
+    uint64_t total_time;                    /**< Sum of the latencies, in nanoseconds. */
+    uint64_t max_time;                      /**< Largest latency, in nanoseconds. */
+    uint64_t histogram[HISTOGRAM_BUCKETS];  /**< Number of latencies in each bucket. */
+    uint64_t allocs;                        /**< Number of blocks allocated. */
+    uint64_t frees;                         /**< Number of blocks freed. */
+    uint64_t alloc_bytes;                   /**< Bytes of the blocks allocated. */
+} command_stats;
+
+typedef struct {
+    uint64_t allocs;                        /**< Number of blocks allocated. */
+    uint64_t frees;                         /**< Number of blocks freed. */
+    uint64_t objects;                       /**< Objects given by pools, in their blocks. */
+    uint64_t alloc_bytes;                   /**< Bytes of the blocks allocated. */
+    uint64_t live_bytes;                    /**< Bytes of the blocks not yet freed. */
+    uint64_t peak_bytes;                    /**< Largest number of live bytes. */
+} alloc_stats;
+
+
+/** Flags indicating the statistics and the allocations are collected. */
+extern int stats_enabled;
+extern int alloc_stats_enabled;
+
+
+/** Statistics functions. */
+void enable_stats(void);
+uint64_t stats_clock(void);
+void start_command_stats(char command);
+void end_command_stats(uint64_t start);
+void stop_command_stats(void);
+void count_error(int error);
+uint64_t get_latency_percentile(command_stats *stats, double percentile);
+void print_stats(FILE *stream);
+
+/** Allocation tracking functions. */
+void enable_alloc_stats(void);
+void *tracked_malloc(size_t size, int type);
+void *tracked_calloc(size_t count, size_t size, int type);
+void *tracked_realloc(void *pointer, size_t old_size, size_t new_size, int type);
+void tracked_free(void *pointer, size_t size, int type);
+void track_object(int type);
+void print_alloc_stats(FILE *stream);
+
+#endif // STATS_H
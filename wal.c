@@ -0,0 +1,480 @@
+/**
+ * File with the write-ahead log of the changes.
+ * @file wal.c
+ * @author ist1106369 Sophia Alencar
+*/
+
+#include <errno.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "aux.h"
+#include "checkpoint.h"
+#include "wal.h"
+
+/**
+ * Gets the size of a record, with its costs and its padded name.
+ * @param command Command of the change.
+ * @param name_length Length of the name of the parking.
+ * @return Size of the record, a multiple of 8.
+ */
+static size_t get_record_size(char command, size_t name_length) {
+    return sizeof(wal_record) + (command == 'p' || command == 'c' ? sizeof(wal_costs) : 0) +
+        ((name_length + 8) & ~(size_t)7);
+}
+
+/**
+ * Gets the checksum of a record, of its sequence number and of all
+ * the bytes after its checksum.
+ * @param bytes The record.
+ * @param size Size of the record.
+ * @return The checksum.
+ */
+static uint64_t get_record_checksum(const char *bytes, size_t size) {
+    const wal_record *record = (const wal_record *)bytes;
+    size_t start = offsetof(wal_record, license_plate);
+
+    return add_checksum(add_checksum(CHECKSUM_SEED, &record->sequence,
+        sizeof(record->sequence)), bytes + start, size - start);
+}
+
+/**
+ * Checks that the bytes at the end of the log hold a whole record that
+ * is not corrupted.
+ * @param bytes The bytes, aligned to 8.
+ * @param size Number of bytes to the end of the log.
+ * @return Size of the record, or 0 if it is not valid (a write cut by a crash).
+ */
+static size_t check_record(const char *bytes, size_t size) {
+    const wal_record *record = (const wal_record *)bytes;
+    const char *name;
+    size_t record_size;
+
+    if (size < sizeof(*record) || record->command == '\0' ||
+        strchr(WAL_COMMANDS, record->command) == NULL || record->name_length >= size) {
+        return 0;
+    }
+    record_size = get_record_size(record->command, record->name_length);
+    if (record_size > size) {
+        return 0;
+    }
+
+    /** The name ends where the record says. */
+    name = bytes + record_size - ((record->name_length + 8) & ~(size_t)7);
+    if (memchr(name, '\0', record->name_length + 1) != name + record->name_length ||
+        get_record_checksum(bytes, record_size) != record->checksum) {
+        return 0;
+    }
+    return record_size;
+}
+
+/**
+ * Applies an entry of the log, as register_entry does after its checks.
+ * @param parking_args Pointer to the args structure containing parking information.
+ * @param my_parking The parking of the entry.
+ * @param record The record of the entry.
+ * @return 0 on success, -1 if the entry is not possible or memory ran out.
+ */
+static int replay_entry(args *parking_args, parking *my_parking, const wal_record *record) {
+    vehicle *my_vehicle = find_vehicle(parking_args->vehicles, record->license_plate);
+    parking_history *history;
+
+    if (my_parking->free_spaces <= 0 || is_vehicle_parked(my_vehicle)) {
+        return -1;
+    }
+    if ((my_vehicle == NULL &&
+        (my_vehicle = add_new_vehicle(parking_args->vehicles, record->license_plate)) == NULL) ||
+        (history = find_parking_history(my_vehicle, my_parking)) == NULL ||
+        append_vehicle_log(history, record->date, parking_args->command_version) == NULL) {
+        return -1;
+    }
+
+    my_vehicle->parking_id = my_parking->id;
+    my_vehicle->is_parked = 1;
+    my_vehicle->last_history = history;
+    my_parking->free_spaces--;
+    return 0;
+}
+
+/**
+ * Applies an exit of the log, as register_exit does after its checks.
+ * @param parking_args Pointer to the args structure containing parking information.
+ * @param my_parking The parking of the exit.
+ * @param record The record of the exit.
+ * @return 0 on success, -1 if the vehicle is not parked there.
+ */
+static int replay_exit(args *parking_args, parking *my_parking, const wal_record *record) {
+    vehicle *my_vehicle = find_vehicle(parking_args->vehicles, record->license_plate);
+    vehicle_log *current_log;
+
+    if (!is_vehicle_parked(my_vehicle) || my_vehicle->parking_id != my_parking->id) {
+        return -1;
+    }
+
+    /** The vehicle entered this parking last, the exit closes that log. */
+    current_log = my_vehicle->last_history->last_log;
+    current_log->exit_date = record->date;
+    current_log->cost = calculate_cost(my_parking, current_log);
+    __atomic_store_n(&current_log->exit_version, parking_args->command_version,
+        __ATOMIC_RELEASE);
+    add_new_exit(my_parking, current_log);
+
+    my_vehicle->is_parked = 0;
+    my_vehicle->parking_id = NO_PARKING;
+    my_parking->free_spaces++;
+    return 0;
+}
+
+/**
+ * Applies a change of the log, as its command did, without any output.
+ * @param parking_args Pointer to the args structure containing parking information.
+ * @param bytes The record of the change.
+ * @return 0 on success, -1 if the change is not possible.
+ */
+static int replay_change(args *parking_args, const char *bytes) {
+    const wal_record *record = (const wal_record *)bytes;
+    const wal_costs *costs = (const wal_costs *)(record + 1);
+    char *name = (char *)(record + 1) +
+        (record->command == 'p' || record->command == 'c' ? sizeof(wal_costs) : 0);
+    parking *my_parking = NULL;
+    tariff *new_tariff;
+    int result = -1, i;
+
+    /** Each change is a command, for the snapshots and the reclaiming. */
+    parking_args->command_version++;
+    if ((record->command != 'p' && record->command != 'R' &&
+        (my_parking = find_parking(parking_args, name)) == NULL) ||
+        ((record->command == 'e' || record->command == 's') &&
+        record->license_plate == EMPTY_KEY)) {
+        return -1;
+    }
+
+    switch (record->command) {
+
+        case 'p':
+            result = add_new_parking(parking_args, name, costs->max_capacity,
+                costs->cost_x, costs->cost_y, costs->cost_z) == 0 ? 0 : -1;
+            break;
+
+        case 'e':
+            result = replay_entry(parking_args, my_parking, record);
+            parking_args->last_date = record->date;
+            break;
+
+        case 's':
+            result = replay_exit(parking_args, my_parking, record);
+            parking_args->last_date = record->date;
+            break;
+
+        case 'r':
+            remove_parking_from_list(parking_args, name);
+            result = 0;
+            break;
+
+        case 'c':
+            if ((new_tariff = create_tariff(record->date, costs->cost_x, costs->cost_y,
+                costs->cost_z)) != NULL) {
+                insert_tariff(my_parking, new_tariff);
+                result = 0;
+            }
+            break;
+
+        case 'R':
+            for (i = 0; i < parking_args->registry.num_parkings; i++) {
+                reprice_parking(parking_args->registry.sorted[i], record->date,
+                    record->last_date);
+            }
+            result = 0;
+            break;
+
+        default:
+            break;
+    }
+
+    reclaim_removed_parkings(parking_args, RECLAIM_STEP);
+    return result;
+}
+
+/**
+ * Replays the changes of the log after the ones already in the checkpoint.
+ * @param parking_args Pointer to the args structure, loaded from the checkpoint.
+ * @param bytes The log, mapped into memory.
+ * @param size Size of the log.
+ * @param valid_size Pointer to the size of the whole records, the rest is cut.
+ * @return 0 on success, -1 if a change is missing or is not possible.
+ */
+static int replay_wal(args *parking_args, const char *bytes, size_t size, size_t *valid_size) {
+    const wal_record *record;
+    size_t offset = 0, record_size;
+
+    while ((record_size = check_record(bytes + offset, size - offset)) > 0) {
+        record = (const wal_record *)(bytes + offset);
+
+        /** The changes before the checkpoint are in it already. */
+        if (record->sequence > parking_args->last_sequence) {
+            if (record->sequence != parking_args->last_sequence + 1 ||
+                replay_change(parking_args, bytes + offset) != 0) {
+                return -1;
+            }
+            parking_args->last_sequence = record->sequence;
+        }
+        offset += record_size;
+    }
+
+    *valid_size = offset;
+    return 0;
+}
+
+/**
+ * Writes the records of the log before any output reports their changes.
+ * @param context Pointer to the writer of the log.
+ */
+static void commit_before_output(void *context) {
+    commit_wal((wal_writer *)context);
+}
+
+/**
+ * Opens the log of the changes, replaying the ones after the checkpoint
+ * already loaded, and cutting a last record that a crash left incomplete.
+ * The changes logged from then on are appended to it.
+ * @param parking_args Pointer to the args structure, loaded from the checkpoint.
+ * @param path Path of the log, created if it does not exist.
+ * @return Pointer to the writer of the log, or NULL if the log is not
+ * valid or could not be opened.
+ */
+wal_writer *open_wal(args *parking_args, const char *path) {
+    wal_writer *wal;
+    struct stat status;
+    size_t valid_size = 0;
+    void *map;
+    int descriptor, result = 0;
+
+    if ((descriptor = open(path, O_RDWR | O_CREAT | O_APPEND, 0644)) < 0) {
+        return NULL;
+    }
+    if (fstat(descriptor, &status) != 0) {
+        close(descriptor);
+        return NULL;
+    }
+
+    if (status.st_size > 0) {
+        if ((map = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0)) ==
+            MAP_FAILED) {
+            close(descriptor);
+            return NULL;
+        }
+        madvise(map, status.st_size, MADV_SEQUENTIAL);
+        result = replay_wal(parking_args, (const char *)map, status.st_size, &valid_size);
+        munmap(map, status.st_size);
+    }
+
+    /** The new records go after the last whole one, on a durable file. */
+    if (result != 0 || ((off_t)valid_size < status.st_size &&
+        (ftruncate(descriptor, valid_size) != 0 || fsync(descriptor) != 0)) ||
+        sync_directory(path) != 0 ||
+        (wal = (wal_writer *)tracked_malloc(sizeof(wal_writer), ALLOC_OTHER)) == NULL) {
+        close(descriptor);
+        return NULL;
+    }
+    wal->descriptor = descriptor;
+    wal->buffer = NULL;
+    wal->length = 0;
+    wal->capacity = 0;
+    wal->num_pending = 0;
+    wal->failed = 0;
+
+    parking_args->wal = wal;
+    set_output_barrier(commit_before_output, wal);
+    return wal;
+}
+
+/**
+ * Starts a record at the end of the buffer, growing it, with the
+ * sequence number of the change and the name of its parking.
+ * @param parking_args Pointer to the args structure containing parking information.
+ * @param command Command of the change.
+ * @param name Name of the parking.
+ * @return Pointer to the record, zeroed, or NULL if nothing is logged.
+ */
+static wal_record *begin_record(args *parking_args, char command, const char *name) {
+    wal_writer *wal = parking_args->wal;
+    size_t name_length, record_size, new_capacity;
+    wal_record *record;
+    char *new_buffer;
+
+    if (wal == NULL || wal->failed) {
+        return NULL;
+    }
+    name_length = strlen(name);
+    record_size = get_record_size(command, name_length);
+
+    /** Grow the buffer, doubling it. */
+    if (wal->length + record_size > wal->capacity) {
+        new_capacity = wal->capacity > 0 ? wal->capacity : INITIAL_WAL_BUFFER;
+        while (wal->length + record_size > new_capacity) {
+            new_capacity *= 2;
+        }
+        if ((new_buffer = (char *)tracked_realloc(wal->buffer, wal->capacity, new_capacity,
+            ALLOC_BUFFER)) == NULL) {
+            fprintf(stderr, "Memory allocation of the log buffer failed\n");
+            wal->failed = 1;
+            return NULL;
+        }
+        wal->buffer = new_buffer;
+        wal->capacity = new_capacity;
+    }
+
+    record = (wal_record *)(wal->buffer + wal->length);
+    memset(record, 0, record_size);
+    record->sequence = ++parking_args->last_sequence;
+    record->name_length = (uint32_t)name_length;
+    record->command = command;
+    memcpy((char *)record + record_size - ((name_length + 8) & ~(size_t)7), name, name_length);
+    return record;
+}
+
+/**
+ * Ends the record at the end of the buffer with its checksum. It is
+ * written with the next group of records, before the output of its command.
+ * @param wal Pointer to the writer of the log.
+ * @param record Pointer to the record, complete.
+ */
+static void end_record(wal_writer *wal, wal_record *record) {
+    size_t record_size = get_record_size(record->command, record->name_length);
+
+    record->checksum = get_record_checksum((char *)record, record_size);
+    wal->length += record_size;
+    if (++wal->num_pending >= WAL_GROUP_RECORDS) {
+        commit_wal(wal);
+    }
+}
+
+/**
+ * Logs a change accepted by a command.
+ * @param parking_args Pointer to the args structure containing parking information.
+ * @param command Command of the change (p, e, s or r).
+ * @param my_parking The parking added, changed or removed.
+ * @param license_plate License plate of the vehicle (e and s).
+ * @param change_date Date of the entry or the exit (e and s).
+ */
+void log_change(args *parking_args, char command, parking *my_parking,
+    plate license_plate, timestamp change_date) {
+    wal_record *record;
+    wal_costs *costs;
+
+    if ((record = begin_record(parking_args, command, my_parking->name)) == NULL) {
+        return;
+    }
+    record->license_plate = license_plate;
+    record->date = change_date;
+
+    /** A parking added has only the tariff of its creation. */
+    if (command == 'p') {
+        costs = (wal_costs *)(record + 1);
+        costs->cost_x = my_parking->tariffs->cost_x;
+        costs->cost_y = my_parking->tariffs->cost_y;
+        costs->cost_z = my_parking->tariffs->cost_z;
+        costs->max_capacity = my_parking->max_capacity;
+    }
+    end_record(parking_args->wal, record);
+}
+
+/**
+ * Logs a tariff added to a parking by c.
+ * @param parking_args Pointer to the args structure containing parking information.
+ * @param my_parking The parking.
+ * @param new_tariff The tariff.
+ */
+void log_tariff(args *parking_args, parking *my_parking, tariff *new_tariff) {
+    wal_record *record;
+    wal_costs *costs;
+
+    if ((record = begin_record(parking_args, 'c', my_parking->name)) == NULL) {
+        return;
+    }
+    record->date = new_tariff->effective_date;
+    costs = (wal_costs *)(record + 1);
+    costs->cost_x = new_tariff->cost_x;
+    costs->cost_y = new_tariff->cost_y;
+    costs->cost_z = new_tariff->cost_z;
+    end_record(parking_args->wal, record);
+}
+
+/**
+ * Logs the stays of all the parkings priced again by R.
+ * @param parking_args Pointer to the args structure containing parking information.
+ * @param first_date The first day.
+ * @param last_date The last day.
+ */
+void log_repricing(args *parking_args, timestamp first_date, timestamp last_date) {
+    wal_record *record;
+
+    if ((record = begin_record(parking_args, 'R', "")) == NULL) {
+        return;
+    }
+    record->date = first_date;
+    record->last_date = last_date;
+    end_record(parking_args->wal, record);
+}
+
+/**
+ * Writes the records in the buffer to the log and flushes them to the
+ * disk, all the group with one write and one flush.
+ * @param wal Pointer to the writer of the log.
+ * @return 0 on success, -1 if they could not be written.
+ */
+int commit_wal(wal_writer *wal) {
+    size_t length = wal->length, written = 0;
+    ssize_t result;
+
+    if (wal->failed) {
+        return -1;
+    }
+    if (length == 0) {
+        return 0;
+    }
+    while (written < length) {
+        if ((result = write(wal->descriptor, wal->buffer + written, length - written)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        written += result;
+    }
+
+    wal->length = 0;
+    wal->num_pending = 0;
+    if (written < length || fdatasync(wal->descriptor) != 0) {
+        fprintf(stderr, "Writing the log of the changes failed, they are no longer logged\n");
+        wal->failed = 1;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Empties the log, once a checkpoint has all its changes.
+ * @param wal Pointer to the writer of the log.
+ * @return 0 on success, -1 if it could not be emptied.
+ */
+int reset_wal(wal_writer *wal) {
+    wal->length = 0;
+    wal->num_pending = 0;
+    return ftruncate(wal->descriptor, 0) == 0 && fsync(wal->descriptor) == 0 ? 0 : -1;
+}
+
+/**
+ * Writes the records left and closes the log.
+ * @param wal Pointer to the writer of the log.
+ */
+void close_wal(wal_writer *wal) {
+    commit_wal(wal);
+    set_output_barrier(NULL, NULL);
+    close(wal->descriptor);
+    tracked_free(wal->buffer, wal->capacity, ALLOC_BUFFER);
+    tracked_free(wal, sizeof(wal_writer), ALLOC_OTHER);
+}
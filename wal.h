@@ -0,0 +1,66 @@
+/**
+ * File with the write-ahead log: the changes accepted by the p, e, s,
+ * r, c and R commands, appended as binary records and made durable in
+ * groups, and replayed on top of the checkpoint at startup.
+ * @file wal.h
+ * @author ist1106369 Sophia Alencar
+*/
+
+#ifndef WAL_H
+#define WAL_H
+
+#include "proj1.h"
+
+/** Commands whose changes are logged. */
+#define WAL_COMMANDS "pesrcR"
+
+/** Max number of records waiting in the buffer before they are written
+ * and flushed to the disk together (the output also waits for them). */
+#define WAL_GROUP_RECORDS 256
+
+/** Initial capacity of the buffer of the records. */
+#define INITIAL_WAL_BUFFER 4096
+
+/** Structs. */
+
+/** Each record is followed by the costs if it adds a parking or a
+ * tariff, and by the name of the parking (empty for R), ending with a
+ * '\0' and padded to 8 bytes. */
+typedef struct {
+    uint64_t sequence;              /**< Sequence number of the change, from 1. */
+    uint64_t checksum;              /**< Checksum of the sequence and the rest of the record. */
+    plate license_plate;            /**< License plate of the vehicle (e and s). */
+    timestamp date;                 /**< Date of e and s, effective date of c, first day of R. */
+    timestamp last_date;            /**< Last day of R. */
+    uint32_t name_length;           /**< Length of the name, without the '\0'. */
+    char command;                   /**< Command of the change (p, e, s, r, c or R). */
+    char padding[3];                /**< Zero. */
+} wal_record;
+
+typedef struct {
+    money cost_x, cost_y, cost_z;   /**< Costs of the parking or the tariff added, in cents. */
+    int32_t max_capacity;           /**< Maximum capacity of the parking (p). */
+    int32_t padding;                /**< Zero. */
+} wal_costs;
+
+typedef struct wal_writer {
+    int descriptor;                 /**< Descriptor of the log, opened to append. */
+    char *buffer;                   /**< Records not yet written. */
+    size_t length;                  /**< Number of bytes in the buffer. */
+    size_t capacity;                /**< Capacity of the buffer. */
+    int num_pending;                /**< Number of records in the buffer. */
+    int failed;                     /**< Flag indicating a write failed, nothing else is logged. */
+} wal_writer;
+
+
+/** Write-ahead log functions. */
+wal_writer *open_wal(args *parking_args, const char *path);
+void log_change(args *parking_args, char command, parking *my_parking,
+    plate license_plate, timestamp change_date);
+void log_tariff(args *parking_args, parking *my_parking, tariff *new_tariff);
+void log_repricing(args *parking_args, timestamp first_date, timestamp last_date);
+int commit_wal(wal_writer *wal);
+int reset_wal(wal_writer *wal);
+void close_wal(wal_writer *wal);
+
+#endif // WAL_H